@@ -0,0 +1,435 @@
+//
+// Root companion that formats, compresses and writes dumps out of the game process.
+//
+
+#include "companion.h"
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <zlib.h>
+#include <cctype>
+#include <cerrno>
+#include <chrono>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "dump_format.h"
+#include "method_symbols.h"
+#include "dump_record.h"
+#include "dump_store.h"
+#include "log.h"
+#include "thread_policy.h"
+
+// Zygisk connects 32-bit processes to a 32-bit companion and 64-bit ones to a 64-bit companion; the
+// ARM helper loaded through NativeBridge has the same pointer size as the x86 module that
+// registered it, so the name only depends on that.
+#if defined(__LP64__)
+#define COMPANION_SOCKET_NAME "zygisk_il2cppdumper64"
+#else
+#define COMPANION_SOCKET_NAME "zygisk_il2cppdumper32"
+#endif
+
+// A registration that is never claimed (the game had no libil2cpp.so, crashed...) expires.
+static constexpr auto kRegistrationTtl = std::chrono::minutes(10);
+// Longest pause between two records before the companion gives up on a session.
+static constexpr int kSessionTimeoutSec = 300;
+
+struct CompanionRequest {
+    int32_t pid;
+    int32_t uid;
+};
+
+struct Registration {
+    uid_t uid;
+    std::chrono::steady_clock::time_point time;
+};
+
+static std::mutex registry_mutex;
+static std::unordered_map<pid_t, Registration> registrations;
+static bool server_started = false;
+
+static bool read_fully(int fd, void *data, size_t length) {
+    auto ptr = (char *) data;
+    while (length > 0) {
+        auto n = read(fd, ptr, length);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        ptr += n;
+        length -= (size_t) n;
+    }
+    return true;
+}
+
+static bool write_fully(int fd, const void *data, size_t length) {
+    auto ptr = (const char *) data;
+    while (length > 0) {
+        auto n = send(fd, ptr, length, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        ptr += n;
+        length -= (size_t) n;
+    }
+    return true;
+}
+
+static socklen_t socket_address(sockaddr_un *addr) {
+    memset(addr, 0, sizeof(*addr));
+    addr->sun_family = AF_UNIX;
+    // sun_path[0] == '\0' selects the abstract namespace: no file, gone when the companion exits.
+    memcpy(addr->sun_path + 1, COMPANION_SOCKET_NAME, sizeof(COMPANION_SOCKET_NAME) - 1);
+    return (socklen_t) (offsetof(sockaddr_un, sun_path) + 1 + sizeof(COMPANION_SOCKET_NAME) - 1);
+}
+
+// Package names only contain [A-Za-z0-9_.]; anything else could escape the output directory.
+static bool valid_package(const std::string &package) {
+    if (package.empty() || package.size() > 255 || package[0] == '.') {
+        return false;
+    }
+    for (auto c: package) {
+        if (!isalnum((unsigned char) c) && c != '_' && c != '.') {
+            return false;
+        }
+    }
+    return true;
+}
+
+class SessionOutput {
+public:
+    ~SessionOutput() {
+        if (file || gz) {
+            discard();
+        }
+    }
+
+    bool open(const std::string &package, const char *name, bool compress) {
+        mkdir(COMPANION_OUTPUT_DIR, 0755);
+        auto dir = std::string(COMPANION_OUTPUT_DIR "/").append(package);
+        if (mkdir(dir.c_str(), 0755) != 0 && errno != EEXIST) {
+            LOGE("companion: mkdir %s failed: %s", dir.c_str(), strerror(errno));
+            return false;
+        }
+        path = dir.append("/").append(name).append(compress ? ".gz" : "");
+        tmp_path = path + ".tmp";
+        if (compress) {
+            gz = gzopen(tmp_path.c_str(), "wb6");
+        } else {
+            file = fopen(tmp_path.c_str(), "w");
+        }
+        if (!file && !gz) {
+            LOGE("companion: unable to open %s: %s", tmp_path.c_str(), strerror(errno));
+            return false;
+        }
+        return true;
+    }
+
+    bool is_open() const {
+        return file || gz;
+    }
+
+    bool write(const std::string &text) {
+        bytes += text.size();
+        if (gz) {
+            return gzwrite(gz, text.data(), (unsigned) text.size()) == (int) text.size();
+        }
+        return fwrite(text.data(), 1, text.size(), file) == text.size();
+    }
+
+    // Closes the temporary file and moves it over the previous dump.
+    bool commit() {
+        auto ok = gz ? gzclose(gz) == Z_OK : fclose(file) == 0;
+        gz = nullptr;
+        file = nullptr;
+        if (!ok || rename(tmp_path.c_str(), path.c_str()) != 0) {
+            LOGE("companion: unable to write %s: %s", path.c_str(), strerror(errno));
+            unlink(tmp_path.c_str());
+            return false;
+        }
+        chmod(path.c_str(), 0644);
+        return true;
+    }
+
+    void discard() {
+        if (gz) {
+            gzclose(gz);
+        } else if (file) {
+            fclose(file);
+        }
+        gz = nullptr;
+        file = nullptr;
+        unlink(tmp_path.c_str());
+    }
+
+    std::string path;
+    uint64_t bytes = 0;
+
+private:
+    std::string tmp_path;
+    FILE *file = nullptr;
+    gzFile gz = nullptr;
+};
+
+static void write_symbols(MethodIndex &index, const CodeInfo &code, uint32_t flags, const std::string &package,
+                          pid_t pid) {
+    index.build(code);
+    MethodSymbols symbols(index, code);
+    // pid is the game's, so profilers attached to it find the map.
+    auto perf_path = perf_map_path(pid);
+    if (flags & kRecordFlagPerfMap && symbols.write_perf_map(perf_path)) {
+        LOGI("companion: perf map: %zu methods -> %s", symbols.size(), perf_path.c_str());
+    }
+    auto elf_path = std::string(COMPANION_OUTPUT_DIR "/").append(package).append("/libil2cpp.so.debug");
+    if (flags & kRecordFlagElfSymbols && symbols.write_elf(elf_path)) {
+        LOGI("companion: symbol file: %zu methods -> %s", symbols.size(), elf_path.c_str());
+    }
+}
+
+static void session_main(int client, pid_t pid) {
+    timeval timeout{kSessionTimeoutSec, 0};
+    setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+    SessionOutput output;
+    SessionOutput skeleton_output;
+    std::unique_ptr<DumpStore> store;
+    std::unique_ptr<StoreFormatter> formatter;
+    std::unique_ptr<MethodIndex> index;
+    CodeInfo code;
+    uint32_t flags = 0;
+    std::vector<std::string> images;
+    std::string package, payload, text;
+    TypeRecord type;
+    SkeletonRecord skeleton;
+    uint32_t types = 0;
+    uint32_t skeletons = 0;
+    bool skeleton_done = false;
+    bool complete = false;
+    while (!complete) {
+        uint8_t header[5];
+        if (!read_fully(client, header, sizeof(header))) {
+            LOGE("companion: pid %d disconnected before the end of the dump", pid);
+            break;
+        }
+        auto length = (uint32_t) header[0] | header[1] << 8 | header[2] << 16 | (uint32_t) header[3] << 24;
+        auto kind = header[4];
+        if (length > kRecordMaxPayload) {
+            LOGE("companion: record of %u bytes from pid %d", length, pid);
+            break;
+        }
+        payload.resize(length);
+        if (!read_fully(client, payload.data(), length)) {
+            break;
+        }
+        RecordReader reader(payload.data(), payload.size());
+        text.clear();
+        auto valid = false;
+        if (kind == RECORD_HELLO) {
+            uint32_t version, io_priority;
+            valid = !output.is_open() && reader.u32(&version) && version == kRecordProtocolVersion &&
+                    reader.u32(&flags) && reader.str(&package) && valid_package(package) &&
+                    reader.u32(&io_priority) && record_read_code_info(reader, &code) &&
+                    output.open(package, "dump.cs", flags & kRecordFlagCompress);
+            // The companion does the disk writes now, so it takes over the game's I/O priority.
+            if (valid) {
+                thread_policy_set_io_priority((int32_t) io_priority);
+            }
+            if (valid && flags & (kRecordFlagPerfMap | kRecordFlagElfSymbols)) {
+                index = std::make_unique<MethodIndex>();
+            }
+            if (valid && flags & kRecordFlagStore) {
+                store = std::make_unique<DumpStore>(COMPANION_OUTPUT_DIR "/store");
+                if (store->open()) {
+                    formatter = std::make_unique<StoreFormatter>(*store, images, package, code.base,
+                                                                 [&output](const std::string &text) {
+                        return output.write(text);
+                    });
+                } else {
+                    store.reset();
+                }
+            }
+        } else if (!output.is_open()) {
+            valid = false;
+        } else if (kind == RECORD_IMAGE) {
+            uint32_t index;
+            std::string name;
+            valid = reader.u32(&index) && index == images.size() && reader.str(&name);
+            if (valid) {
+                format_image(index, name, &text);
+                images.emplace_back(std::move(name));
+            }
+        } else if (kind == RECORD_SKELETON) {
+            skeleton = SkeletonRecord{};
+            valid = !skeleton_done && record_read_skeleton(reader, &skeleton) && skeleton.image_index < images.size();
+            if (valid && !skeleton_output.is_open()) {
+                valid = skeleton_output.open(package, "dump_types.tsv", false);
+                std::string header;
+                format_skeleton_header(&header);
+                valid = valid && skeleton_output.write(header);
+            }
+            if (valid) {
+                std::string line;
+                format_skeleton(skeleton, images[skeleton.image_index], &line);
+                valid = skeleton_output.write(line);
+                skeletons++;
+            }
+        } else if (kind == RECORD_SKELETON_END) {
+            // The type index is usable as soon as it is committed, long before the full dump.
+            uint32_t count;
+            valid = !skeleton_done && reader.u32(&count) && count == skeletons &&
+                    (!skeleton_output.is_open() || skeleton_output.commit());
+            skeleton_done = true;
+            if (valid && skeletons) {
+                LOGI("companion: %s: %u types -> %s", package.c_str(), skeletons, skeleton_output.path.c_str());
+            }
+        } else if (kind == RECORD_TYPE) {
+            skeleton_done = true;
+            valid = record_read_type(reader, &type) && type.image_index < images.size();
+            if (valid && index) {
+                index->add_type(type);
+            }
+            if (valid && formatter) {
+                valid = formatter->add(type);
+            } else if (valid) {
+                format_type(type, images[type.image_index], &text);
+            }
+            types++;
+        } else if (kind == RECORD_END) {
+            uint32_t count;
+            valid = reader.u32(&count) && count == types && (!formatter || formatter->finish());
+            complete = valid;
+        }
+        if (!valid || !reader.done()) {
+            LOGE("companion: invalid record %u from pid %d", kind, pid);
+            break;
+        }
+        if (!text.empty() && !output.write(text)) {
+            LOGE("companion: write failed for %s", output.path.c_str());
+            break;
+        }
+    }
+    uint8_t status = complete && output.commit();
+    if (status) {
+        LOGI("companion: %s (pid %d): %u types, %llu bytes -> %s", package.c_str(), pid, types,
+             (unsigned long long) output.bytes, output.path.c_str());
+        if (store) {
+            LOGI("companion: store: %u images reused, %u stored, %u deduplicated", store->reused, store->stored,
+                 store->deduplicated);
+        }
+        if (index) {
+            write_symbols(*index, code, flags, package, pid);
+        }
+    }
+    write_fully(client, &status, sizeof(status));
+    close(client);
+}
+
+// Claims the registration of pid, which must have been made for the same uid.
+static bool take_registration(pid_t pid, uid_t uid) {
+    std::lock_guard<std::mutex> lock(registry_mutex);
+    auto it = registrations.find(pid);
+    if (it == registrations.end() || it->second.uid != uid) {
+        return false;
+    }
+    registrations.erase(it);
+    return true;
+}
+
+static void accept_loop(int server) {
+    while (true) {
+        int client = accept4(server, nullptr, nullptr, SOCK_CLOEXEC);
+        if (client == -1) {
+            if (errno != EINTR && errno != ECONNABORTED) {
+                LOGE("companion: accept failed: %s", strerror(errno));
+                sleep(1);
+            }
+            continue;
+        }
+        ucred cred{};
+        socklen_t length = sizeof(cred);
+        if (getsockopt(client, SOL_SOCKET, SO_PEERCRED, &cred, &length) != 0 ||
+            !take_registration(cred.pid, cred.uid)) {
+            LOGW("companion: rejected connection from pid %d uid %d", cred.pid, cred.uid);
+            close(client);
+            continue;
+        }
+        std::thread(session_main, client, cred.pid).detach();
+    }
+}
+
+static bool start_server() {
+    int server = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (server == -1) {
+        LOGE("companion: socket failed: %s", strerror(errno));
+        return false;
+    }
+    sockaddr_un addr{};
+    auto length = socket_address(&addr);
+    if (bind(server, (sockaddr *) &addr, length) != 0 || listen(server, 16) != 0) {
+        LOGE("companion: unable to listen on @%s: %s", COMPANION_SOCKET_NAME, strerror(errno));
+        close(server);
+        return false;
+    }
+    std::thread(accept_loop, server).detach();
+    LOGI("companion: listening on @%s", COMPANION_SOCKET_NAME);
+    return true;
+}
+
+void companion_handler(int client) {
+    CompanionRequest request{};
+    uint8_t status = 0;
+    if (read_fully(client, &request, sizeof(request))) {
+        std::lock_guard<std::mutex> lock(registry_mutex);
+        if (!server_started) {
+            server_started = start_server();
+        }
+        if (server_started) {
+            auto now = std::chrono::steady_clock::now();
+            for (auto it = registrations.begin(); it != registrations.end();) {
+                it = now - it->second.time > kRegistrationTtl ? registrations.erase(it) : std::next(it);
+            }
+            registrations[request.pid] = {(uid_t) request.uid, now};
+            status = 1;
+        }
+    }
+    write_fully(client, &status, sizeof(status));
+}
+
+bool companion_register(int fd, uid_t uid) {
+    CompanionRequest request{getpid(), (int32_t) uid};
+    uint8_t status = 0;
+    auto registered = write_fully(fd, &request, sizeof(request)) && read_fully(fd, &status, sizeof(status)) &&
+                      status == 1;
+    close(fd);
+    return registered;
+}
+
+int companion_connect() {
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd == -1) {
+        return -1;
+    }
+    sockaddr_un addr{};
+    auto length = socket_address(&addr);
+    if (connect(fd, (sockaddr *) &addr, length) != 0) {
+        LOGW("companion: unable to connect to @%s: %s", COMPANION_SOCKET_NAME, strerror(errno));
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
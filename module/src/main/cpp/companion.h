@@ -0,0 +1,29 @@
+//
+// Root companion that formats, compresses and writes dumps out of the game process.
+//
+// connectCompanion() only works before specialization and Zygisk closes the fds a module opens
+// there, so the socket cannot be kept for the dump itself. Instead preAppSpecialize registers the
+// process with the companion, which starts a listening socket in the abstract namespace; once il2cpp
+// is ready the game connects to it and streams records (see dump_record.h). The companion accepts a
+// connection only from a registered pid whose uid matches.
+//
+
+#ifndef ZYGISK_IL2CPPDUMPER_COMPANION_H
+#define ZYGISK_IL2CPPDUMPER_COMPANION_H
+
+#include <sys/types.h>
+
+// Directory of the companion's output, one subdirectory per package.
+#define COMPANION_OUTPUT_DIR "/data/local/tmp/Il2CppDumper"
+
+// REGISTER_ZYGISK_COMPANION handler, runs in the root companion process.
+void companion_handler(int client);
+
+// Called from preAppSpecialize with the socket from connectCompanion(). Registers the current pid
+// under uid and closes the socket. Returns false if the companion could not start its server.
+bool companion_register(int fd, uid_t uid);
+
+// Connects to the companion's dump server. Returns -1 if it is not reachable.
+int companion_connect();
+
+#endif //ZYGISK_IL2CPPDUMPER_COMPANION_H
@@ -0,0 +1,125 @@
+//
+// Dumper options, read from config.txt in the module directory during preAppSpecialize.
+//
+
+#include "config.h"
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include "log.h"
+
+static DumperConfig current_config = {
+#define DUMPER_CONFIG_DEFAULT(name, value) value,
+        DUMPER_CONFIG_OPTIONS(DUMPER_CONFIG_DEFAULT)
+#undef DUMPER_CONFIG_DEFAULT
+};
+
+bool config_read_lines(int dirfd, const char *name, std::vector<std::string> *lines) {
+    int fd = openat(dirfd, name, O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        return false;
+    }
+    std::string content;
+    char buf[4096];
+    ssize_t n;
+    while ((n = read(fd, buf, sizeof(buf))) > 0) {
+        content.append(buf, (size_t) n);
+    }
+    close(fd);
+
+    size_t pos = 0;
+    while (pos < content.size()) {
+        auto end = content.find('\n', pos);
+        if (end == std::string::npos) {
+            end = content.size();
+        }
+        auto line = content.substr(pos, end - pos);
+        pos = end + 1;
+        auto comment = line.find('#');
+        if (comment != std::string::npos) {
+            line.resize(comment);
+        }
+        auto first = line.find_first_not_of(" \t\r");
+        if (first == std::string::npos) {
+            continue;
+        }
+        auto last = line.find_last_not_of(" \t\r");
+        lines->emplace_back(line.substr(first, last - first + 1));
+    }
+    return true;
+}
+
+static bool config_apply(DumperConfig *config, const std::string &key, const std::string &value) {
+    char *end = nullptr;
+    errno = 0;
+    auto number = strtol(value.c_str(), &end, 0);
+    if (value.empty() || *end != '\0' || errno != 0 || number < INT32_MIN || number > INT32_MAX) {
+        LOGW("config: invalid value for %s: %s", key.c_str(), value.c_str());
+        return false;
+    }
+#define DUMPER_CONFIG_APPLY(name, value) \
+    if (key == #name) {                  \
+        config->name = (int32_t) number; \
+        return true;                     \
+    }
+    DUMPER_CONFIG_OPTIONS(DUMPER_CONFIG_APPLY)
+#undef DUMPER_CONFIG_APPLY
+    LOGW("config: unknown option %s", key.c_str());
+    return false;
+}
+
+// Joins the lines of dirfd/name with '\n' into buffer.
+static void config_load_lines(int dirfd, const char *name, char *buffer, size_t size) {
+    std::vector<std::string> lines;
+    if (!config_read_lines(dirfd, name, &lines)) {
+        return;
+    }
+    std::string joined;
+    for (auto &line: lines) {
+        if (joined.size() + line.size() + 1 >= size) {
+            LOGW("config: %s is longer than %zu bytes, ignoring from %s", name, size - 1, line.c_str());
+            break;
+        }
+        joined.append(line).append("\n");
+    }
+    strlcpy(buffer, joined.c_str(), size);
+}
+
+void config_load(int dirfd, DumperConfig *config) {
+    *config = DumperConfig{
+#define DUMPER_CONFIG_DEFAULT(name, value) value,
+            DUMPER_CONFIG_OPTIONS(DUMPER_CONFIG_DEFAULT)
+#undef DUMPER_CONFIG_DEFAULT
+    };
+    if (dirfd == -1) {
+        return;
+    }
+    config_load_lines(dirfd, "filters.txt", config->filters, sizeof(config->filters));
+    config_load_lines(dirfd, "signatures.txt", config->signatures, sizeof(config->signatures));
+    std::vector<std::string> lines;
+    if (!config_read_lines(dirfd, "config.txt", &lines)) {
+        return;
+    }
+    for (auto &line: lines) {
+        auto eq = line.find('=');
+        if (eq == std::string::npos) {
+            LOGW("config: ignoring line without '=': %s", line.c_str());
+            continue;
+        }
+        auto key = line.substr(0, eq);
+        auto value = line.substr(eq + 1);
+        key.erase(key.find_last_not_of(" \t") + 1);
+        value.erase(0, value.find_first_not_of(" \t"));
+        config_apply(config, key, value);
+    }
+}
+
+void config_set(const DumperConfig &config) {
+    current_config = config;
+}
+
+const DumperConfig &config_get() {
+    return current_config;
+}
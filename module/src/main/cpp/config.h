@@ -0,0 +1,65 @@
+//
+// Dumper options, read from config.txt in the module directory during preAppSpecialize.
+//
+// The struct only holds int32_t fields and char arrays so it has the same layout in the x86 module
+// and in the ARM helper loaded through NativeBridge, which receives it via JNI_OnLoad's reserved.
+//
+
+#ifndef ZYGISK_IL2CPPDUMPER_CONFIG_H
+#define ZYGISK_IL2CPPDUMPER_CONFIG_H
+
+#include <stdint.h>
+#include <linux/limits.h>
+#include <string>
+#include <vector>
+
+// X(name, default value): one int32_t option per entry, written as "name=value" in config.txt.
+#define DUMPER_CONFIG_OPTIONS(X) \
+    X(companion, 0)              \
+    X(compress, 0)               \
+    X(store, 0)                  \
+    X(dump_nice, 10)             \
+    X(dump_sched, 0)             \
+    X(little_cores, 0)           \
+    X(io_priority, 7)            \
+    X(slice_budget_us, 0)        \
+    X(slice_pause_us, 4000)      \
+    X(staged, 0)                 \
+    X(generic_names, 1)          \
+    X(attributes, 0)             \
+    X(direct_structs, 1)         \
+    X(metadata_dump, 0)          \
+    X(image_dump, 0)             \
+    X(perf_map, 0)               \
+    X(elf_symbols, 0)            \
+    X(method_index, 0)           \
+    X(symbolizer, 0)             \
+    X(profiler_hz, 0)            \
+    X(profiler_seconds, 30)
+
+struct DumperConfig {
+#define DUMPER_CONFIG_FIELD(name, value) int32_t name;
+    DUMPER_CONFIG_OPTIONS(DUMPER_CONFIG_FIELD)
+#undef DUMPER_CONFIG_FIELD
+    char package_name[256];
+    char game_data_dir[PATH_MAX];
+    // Rules from filters.txt, one per line, compiled by DumpFilter in the dump thread.
+    char filters[4096];
+    // "name=pattern" lines from signatures.txt, searched for in libil2cpp.so after the dump.
+    char signatures[4096];
+};
+
+// Reads dirfd/name line by line, dropping '#' comments, surrounding whitespace and empty lines.
+// Returns false if the file cannot be opened.
+bool config_read_lines(int dirfd, const char *name, std::vector<std::string> *lines);
+
+// Fills config with the defaults and then applies config.txt, filters.txt and signatures.txt from
+// dirfd, if present.
+void config_load(int dirfd, DumperConfig *config);
+
+// Makes config the process-wide configuration returned by config_get().
+void config_set(const DumperConfig &config);
+
+const DumperConfig &config_get();
+
+#endif //ZYGISK_IL2CPPDUMPER_CONFIG_H
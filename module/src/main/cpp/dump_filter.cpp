@@ -0,0 +1,163 @@
+//
+// Include/exclude filters on image name, namespace and type name, read from filters.txt.
+//
+
+#include "dump_filter.h"
+#include <algorithm>
+#include <cstring>
+#include "log.h"
+#include "stats.h"
+
+static bool glob_match(const char *pattern, const char *name) {
+    const char *star = nullptr, *resume = nullptr;
+    while (*name) {
+        if (*pattern == '?' || (*pattern && *pattern != '*' && *pattern == *name)) {
+            pattern++;
+            name++;
+        } else if (*pattern == '*') {
+            star = pattern++;
+            resume = name;
+        } else if (star) {
+            pattern = star + 1;
+            name = ++resume;
+        } else {
+            return false;
+        }
+    }
+    while (*pattern == '*') {
+        pattern++;
+    }
+    return !*pattern;
+}
+
+uint32_t NameMatcher::child(uint32_t node, char c) const {
+    auto &children = nodes[node].children;
+    auto it = std::lower_bound(children.begin(), children.end(), c,
+                               [](const std::pair<char, uint32_t> &entry, char key) { return entry.first < key; });
+    return it != children.end() && it->first == c ? it->second : 0;
+}
+
+void NameMatcher::add(const std::string &pattern) {
+    rules++;
+    auto wildcard = pattern.find_first_of("*?");
+    auto is_prefix = wildcard == pattern.size() - 1 && pattern.back() == '*';
+    if (wildcard != std::string::npos && !is_prefix) {
+        globs.push_back(pattern);
+        return;
+    }
+    auto length = is_prefix ? pattern.size() - 1 : pattern.size();
+    uint32_t node = 0;
+    for (size_t i = 0; i < length; ++i) {
+        auto c = pattern[i];
+        auto next = child(node, c);
+        if (!next) {
+            next = (uint32_t) nodes.size();
+            nodes.emplace_back();
+            auto &children = nodes[node].children;
+            auto it = std::lower_bound(children.begin(), children.end(), c,
+                                       [](const std::pair<char, uint32_t> &entry, char key) { return entry.first < key; });
+            children.insert(it, {c, next});
+        }
+        node = next;
+    }
+    if (is_prefix) {
+        nodes[node].prefix = true;
+    } else {
+        nodes[node].exact = true;
+    }
+}
+
+bool NameMatcher::match(const char *name) const {
+    uint32_t node = 0;
+    for (auto p = name; ; ++p) {
+        if (nodes[node].prefix) {
+            return true;
+        }
+        if (!*p) {
+            if (nodes[node].exact) {
+                return true;
+            }
+            break;
+        }
+        node = child(node, *p);
+        if (!node) {
+            break;
+        }
+    }
+    for (auto &glob: globs) {
+        if (glob_match(glob.c_str(), name)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void DumpFilter::compile(const char *rules) {
+    static const char *kind_names[KIND_COUNT] = {"image", "namespace", "type"};
+    auto line_start = rules;
+    while (*line_start) {
+        auto line_end = strchrnul(line_start, '\n');
+        std::string line(line_start, line_end);
+        line_start = *line_end ? line_end + 1 : line_end;
+        if (line.empty()) {
+            continue;
+        }
+        auto colon = line.find(':');
+        if ((line[0] != '+' && line[0] != '-') || colon == std::string::npos || colon + 1 == line.size()) {
+            LOGW("filter: invalid rule %s", line.c_str());
+            continue;
+        }
+        auto kind_name = line.substr(1, colon - 1);
+        int kind = 0;
+        while (kind < KIND_COUNT && kind_name != kind_names[kind]) {
+            kind++;
+        }
+        if (kind == KIND_COUNT) {
+            LOGW("filter: unknown kind in %s", line.c_str());
+            continue;
+        }
+        (line[0] == '+' ? include : exclude)[kind].add(line.substr(colon + 1));
+        rule_count++;
+    }
+    if (rule_count) {
+        LOGI("filter: %u rules", rule_count);
+    }
+}
+
+bool DumpFilter::accept(const NameMatcher &include, const NameMatcher &exclude, const char *name) {
+    if (!include.empty() && !include.match(name)) {
+        return false;
+    }
+    return exclude.empty() || !exclude.match(name);
+}
+
+bool DumpFilter::accept_image(const char *name) {
+    if (accept(include[KIND_IMAGE], exclude[KIND_IMAGE], name)) {
+        return true;
+    }
+    images_rejected++;
+    return false;
+}
+
+bool DumpFilter::accept_class(const char *namespaze, const char *name) {
+    auto accepted = accept(include[KIND_NAMESPACE], exclude[KIND_NAMESPACE], namespaze);
+    if (accepted && !(include[KIND_TYPE].empty() && exclude[KIND_TYPE].empty())) {
+        full_name.assign(namespaze);
+        if (!full_name.empty()) {
+            full_name.push_back('.');
+        }
+        full_name.append(name);
+        accepted = accept(include[KIND_TYPE], exclude[KIND_TYPE], full_name.c_str());
+    }
+    (accepted ? classes_accepted : classes_rejected)++;
+    return accepted;
+}
+
+void DumpFilter::record_stats() const {
+    if (!rule_count) {
+        return;
+    }
+    stats_record("filter_images_rejected", "%u", images_rejected);
+    stats_record("filter_classes_accepted", "%u", classes_accepted);
+    stats_record("filter_classes_rejected", "%u", classes_rejected);
+}
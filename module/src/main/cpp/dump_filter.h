@@ -0,0 +1,76 @@
+//
+// Include/exclude filters on image name, namespace and type name, read from filters.txt.
+//
+// One rule per line: [+|-]<image|namespace|type>:<pattern>. '+' includes, '-' excludes. A pattern
+// ending in a single '*' is a prefix, a pattern without wildcards is an exact name, and anything
+// else is a glob with '*' and '?'. Types are matched by their full name, "Namespace.Name".
+//
+// When a kind has include rules, a name must match one of them; a name matching an exclude rule is
+// always rejected. Exact and prefix rules of each kind are compiled into one trie, so matching a
+// name costs a single walk over its characters whatever the number of rules.
+//
+
+#ifndef ZYGISK_IL2CPPDUMPER_DUMP_FILTER_H
+#define ZYGISK_IL2CPPDUMPER_DUMP_FILTER_H
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+class NameMatcher {
+public:
+    void add(const std::string &pattern);
+
+    // Counts rules, not trie nodes: "*" only marks the root.
+    bool empty() const { return rules == 0; }
+
+    bool match(const char *name) const;
+
+private:
+    struct Node {
+        std::vector<std::pair<char, uint32_t>> children; // sorted by character
+        bool exact = false;  // a rule ends here
+        bool prefix = false; // a prefix rule ends here: every longer name matches too
+    };
+
+    uint32_t child(uint32_t node, char c) const;
+
+    std::vector<Node> nodes{1};
+    std::vector<std::string> globs;
+    uint32_t rules = 0;
+};
+
+class DumpFilter {
+public:
+    // Compiles newline-separated rules. Invalid lines are logged and ignored.
+    void compile(const char *rules);
+
+    bool empty() const { return rule_count == 0; }
+
+    // Whole images are rejected before any of their classes is visited.
+    bool accept_image(const char *name);
+
+    // Checked with the class's namespace and name only, before any member is read.
+    bool accept_class(const char *namespaze, const char *name);
+
+    void reset_counters() { images_rejected = classes_accepted = classes_rejected = 0; }
+
+    // Records the counters of the last pass in the stats.
+    void record_stats() const;
+
+    uint32_t images_rejected = 0;
+    uint32_t classes_accepted = 0;
+    uint32_t classes_rejected = 0;
+
+private:
+    enum Kind { KIND_IMAGE, KIND_NAMESPACE, KIND_TYPE, KIND_COUNT };
+
+    static bool accept(const NameMatcher &include, const NameMatcher &exclude, const char *name);
+
+    NameMatcher include[KIND_COUNT];
+    NameMatcher exclude[KIND_COUNT];
+    uint32_t rule_count = 0;
+    std::string full_name;
+};
+
+#endif //ZYGISK_IL2CPPDUMPER_DUMP_FILTER_H
@@ -0,0 +1,333 @@
+//
+// Formats dump records as dump.cs text.
+//
+
+#include "dump_format.h"
+#include <cctype>
+#include <cinttypes>
+#include <cstdio>
+#include <string_view>
+#include "il2cpp-tabledefs.h"
+
+static void append_hex(std::string *out, uint64_t value) {
+    char buf[17];
+    snprintf(buf, sizeof(buf), "%" PRIx64, value);
+    out->append(buf);
+}
+
+static void append_dec(std::string *out, uint64_t value) {
+    char buf[21];
+    snprintf(buf, sizeof(buf), "%" PRIu64, value);
+    out->append(buf);
+}
+
+std::string get_method_modifier(uint32_t flags) {
+    std::string outPut;
+    auto access = flags & METHOD_ATTRIBUTE_MEMBER_ACCESS_MASK;
+    switch (access) {
+        case METHOD_ATTRIBUTE_PRIVATE:
+            outPut += "private ";
+            break;
+        case METHOD_ATTRIBUTE_PUBLIC:
+            outPut += "public ";
+            break;
+        case METHOD_ATTRIBUTE_FAMILY:
+            outPut += "protected ";
+            break;
+        case METHOD_ATTRIBUTE_ASSEM:
+        case METHOD_ATTRIBUTE_FAM_AND_ASSEM:
+            outPut += "internal ";
+            break;
+        case METHOD_ATTRIBUTE_FAM_OR_ASSEM:
+            outPut += "protected internal ";
+            break;
+    }
+    if (flags & METHOD_ATTRIBUTE_STATIC) {
+        outPut += "static ";
+    }
+    if (flags & METHOD_ATTRIBUTE_ABSTRACT) {
+        outPut += "abstract ";
+        if ((flags & METHOD_ATTRIBUTE_VTABLE_LAYOUT_MASK) == METHOD_ATTRIBUTE_REUSE_SLOT) {
+            outPut += "override ";
+        }
+    } else if (flags & METHOD_ATTRIBUTE_FINAL) {
+        if ((flags & METHOD_ATTRIBUTE_VTABLE_LAYOUT_MASK) == METHOD_ATTRIBUTE_REUSE_SLOT) {
+            outPut += "sealed override ";
+        }
+    } else if (flags & METHOD_ATTRIBUTE_VIRTUAL) {
+        if ((flags & METHOD_ATTRIBUTE_VTABLE_LAYOUT_MASK) == METHOD_ATTRIBUTE_NEW_SLOT) {
+            outPut += "virtual ";
+        } else {
+            outPut += "override ";
+        }
+    }
+    if (flags & METHOD_ATTRIBUTE_PINVOKE_IMPL) {
+        outPut += "extern ";
+    }
+    return outPut;
+}
+
+static void format_attributes(const std::vector<std::string> &attributes, const char *indent, std::string *out) {
+    for (auto &attribute: attributes) {
+        out->append(indent).append("[").append(attribute).append("]\n");
+    }
+}
+
+static void format_methods(const TypeRecord &type, bool with_va, std::string *out) {
+    out->append("\n\t// Methods\n");
+    for (auto &method: type.methods) {
+        format_attributes(method.attributes, "\t", out);
+        if (method.va) {
+            out->append("\t// RVA: 0x");
+            append_hex(out, method.rva);
+            if (with_va) {
+                out->append(" VA: 0x");
+                append_hex(out, method.va);
+            }
+        } else {
+            out->append("\t// RVA: 0x VA: 0x0");
+        }
+        out->append("\n\t");
+        out->append(get_method_modifier(method.flags));
+        //TODO genericContainerIndex
+        if (method.return_byref) {
+            out->append("ref ");
+        }
+        out->append(method.return_type).append(" ").append(method.name).append("(");
+        for (size_t i = 0; i < method.params.size(); ++i) {
+            auto &param = method.params[i];
+            auto attrs = param.attrs;
+            if (i > 0) {
+                out->append(", ");
+            }
+            if (param.byref) {
+                if (attrs & PARAM_ATTRIBUTE_OUT && !(attrs & PARAM_ATTRIBUTE_IN)) {
+                    out->append("out ");
+                } else if (attrs & PARAM_ATTRIBUTE_IN && !(attrs & PARAM_ATTRIBUTE_OUT)) {
+                    out->append("in ");
+                } else {
+                    out->append("ref ");
+                }
+            } else {
+                if (attrs & PARAM_ATTRIBUTE_IN) {
+                    out->append("[In] ");
+                }
+                if (attrs & PARAM_ATTRIBUTE_OUT) {
+                    out->append("[Out] ");
+                }
+            }
+            out->append(param.type_name).append(" ").append(param.name);
+        }
+        out->append(") { }\n");
+        //TODO GenericInstMethod
+    }
+}
+
+static void format_properties(const TypeRecord &type, std::string *out) {
+    out->append("\n\t// Properties\n");
+    for (auto &property: type.properties) {
+        // No attributes: il2cpp exports no il2cpp_custom_attrs_from_property to read them with.
+        out->append("\t");
+        if (property.has_get || property.has_set) {
+            out->append(get_method_modifier(property.accessor_flags));
+        }
+        if (property.known) {
+            out->append(property.type_name).append(" ").append(property.name).append(" { ");
+            if (property.has_get) {
+                out->append("get; ");
+            }
+            if (property.has_set) {
+                out->append("set; ");
+            }
+            out->append("}\n");
+        } else if (!property.name.empty()) {
+            out->append(" // unknown property ").append(property.name);
+        }
+    }
+}
+
+static void format_fields(const TypeRecord &type, std::string *out) {
+    out->append("\n\t// Fields\n");
+    for (auto &field: type.fields) {
+        format_attributes(field.attributes, "\t", out);
+        out->append("\t");
+        auto attrs = field.flags;
+        auto access = attrs & FIELD_ATTRIBUTE_FIELD_ACCESS_MASK;
+        switch (access) {
+            case FIELD_ATTRIBUTE_PRIVATE:
+                out->append("private ");
+                break;
+            case FIELD_ATTRIBUTE_PUBLIC:
+                out->append("public ");
+                break;
+            case FIELD_ATTRIBUTE_FAMILY:
+                out->append("protected ");
+                break;
+            case FIELD_ATTRIBUTE_ASSEMBLY:
+            case FIELD_ATTRIBUTE_FAM_AND_ASSEM:
+                out->append("internal ");
+                break;
+            case FIELD_ATTRIBUTE_FAM_OR_ASSEM:
+                out->append("protected internal ");
+                break;
+        }
+        if (attrs & FIELD_ATTRIBUTE_LITERAL) {
+            out->append("const ");
+        } else {
+            if (attrs & FIELD_ATTRIBUTE_STATIC) {
+                out->append("static ");
+            }
+            if (attrs & FIELD_ATTRIBUTE_INIT_ONLY) {
+                out->append("readonly ");
+            }
+        }
+        out->append(field.type_name).append(" ").append(field.name);
+        if (field.has_value) {
+            out->append(" = ");
+            append_dec(out, field.value);
+        }
+        out->append("; // 0x");
+        append_hex(out, field.offset);
+        out->append("\n");
+    }
+}
+
+static void format_events(const TypeRecord &type, std::string *out) {
+    if (type.events.empty()) {
+        return;
+    }
+    out->append("\n\t// Events\n");
+    for (auto &event: type.events) {
+        out->append("\t").append(get_method_modifier(event.accessor_flags)).append("event ");
+        out->append(event.type_name).append(" ").append(event.name).append(";\n");
+    }
+}
+
+static void format_nested_types(const TypeRecord &type, std::string *out) {
+    if (type.nested_types.empty()) {
+        return;
+    }
+    out->append("\n\t// Nested types\n");
+    for (auto &name: type.nested_types) {
+        out->append("\t// ").append(name).append("\n");
+    }
+}
+
+std::string format_full_name(const TypeRecord &type) {
+    std::string name;
+    if (!type.declaring_type.empty()) {
+        name.append(type.declaring_type).push_back('.');
+    } else if (!type.namespaze.empty()) {
+        name.append(type.namespaze).push_back('.');
+    }
+    return name.append(type.name);
+}
+
+void format_image(uint32_t index, const std::string &image_name, std::string *out) {
+    out->append("// Image ");
+    append_dec(out, index);
+    out->append(": ").append(image_name).append("\n");
+}
+
+void format_type(const TypeRecord &type, const std::string &image_name, std::string *out, bool with_va) {
+    out->append("\n// Dll : ").append(image_name);
+    out->append("\n// Namespace: ").append(type.namespaze).append("\n");
+    if (!type.declaring_type.empty()) {
+        out->append("// Declaring type: ").append(type.declaring_type).append("\n");
+    }
+    auto flags = type.flags;
+    if (flags & TYPE_ATTRIBUTE_SERIALIZABLE) {
+        out->append("[Serializable]\n");
+    }
+    format_attributes(type.attributes, "", out);
+    auto is_valuetype = type.is_valuetype;
+    auto is_enum = type.is_enum;
+    auto visibility = flags & TYPE_ATTRIBUTE_VISIBILITY_MASK;
+    switch (visibility) {
+        case TYPE_ATTRIBUTE_PUBLIC:
+        case TYPE_ATTRIBUTE_NESTED_PUBLIC:
+            out->append("public ");
+            break;
+        case TYPE_ATTRIBUTE_NOT_PUBLIC:
+        case TYPE_ATTRIBUTE_NESTED_FAM_AND_ASSEM:
+        case TYPE_ATTRIBUTE_NESTED_ASSEMBLY:
+            out->append("internal ");
+            break;
+        case TYPE_ATTRIBUTE_NESTED_PRIVATE:
+            out->append("private ");
+            break;
+        case TYPE_ATTRIBUTE_NESTED_FAMILY:
+            out->append("protected ");
+            break;
+        case TYPE_ATTRIBUTE_NESTED_FAM_OR_ASSEM:
+            out->append("protected internal ");
+            break;
+    }
+    if (flags & TYPE_ATTRIBUTE_ABSTRACT && flags & TYPE_ATTRIBUTE_SEALED) {
+        out->append("static ");
+    } else if (!(flags & TYPE_ATTRIBUTE_INTERFACE) && flags & TYPE_ATTRIBUTE_ABSTRACT) {
+        out->append("abstract ");
+    } else if (!is_valuetype && !is_enum && flags & TYPE_ATTRIBUTE_SEALED) {
+        out->append("sealed ");
+    }
+    if (flags & TYPE_ATTRIBUTE_INTERFACE) {
+        out->append("interface ");
+    } else if (is_enum) {
+        out->append("enum ");
+    } else if (is_valuetype) {
+        out->append("struct ");
+    } else {
+        out->append("class ");
+    }
+    out->append(type.name); //TODO genericContainerIndex
+    for (size_t i = 0; i < type.extends.size(); ++i) {
+        out->append(i == 0 ? " : " : ", ").append(type.extends[i]);
+    }
+    out->append("\n{");
+    format_fields(type, out);
+    format_properties(type, out);
+    format_methods(type, with_va, out);
+    format_events(type, out);
+    format_nested_types(type, out);
+    out->append("}\n");
+}
+
+void format_add_va(const char *text, size_t size, uint64_t base, std::string *out) {
+    static constexpr char kMarker[] = "\t// RVA: 0x";
+    static constexpr size_t kMarkerSize = sizeof(kMarker) - 1;
+    std::string_view rest(text, size);
+    for (auto pos = rest.find(kMarker); pos != std::string_view::npos; pos = rest.find(kMarker)) {
+        auto digits = pos + kMarkerSize;
+        auto end = digits;
+        uint64_t rva = 0;
+        for (; end < rest.size() && isxdigit((unsigned char) rest[end]); ++end) {
+            rva = rva << 4 | (uint64_t) (isdigit((unsigned char) rest[end]) ? rest[end] - '0' :
+                                         (tolower((unsigned char) rest[end]) - 'a' + 10));
+        }
+        out->append(rest.data(), end);
+        // Methods without a body keep their "RVA: 0x VA: 0x0" line as it is.
+        if (end > digits && end < rest.size() && rest[end] == '\n') {
+            out->append(" VA: 0x");
+            append_hex(out, base + rva);
+        }
+        rest.remove_prefix(end);
+    }
+    out->append(rest.data(), rest.size());
+}
+
+void format_skeleton_header(std::string *out) {
+    out->append("# image\ttoken\tflags\tnamespace\tname\tparent\tinterfaces\n");
+}
+
+void format_skeleton(const SkeletonRecord &skeleton, const std::string &image_name, std::string *out) {
+    out->append(image_name).append("\t0x");
+    append_hex(out, skeleton.token);
+    out->append("\t0x");
+    append_hex(out, skeleton.flags);
+    out->append("\t").append(skeleton.namespaze).append("\t").append(skeleton.name);
+    out->append("\t").append(skeleton.parent).append("\t");
+    for (size_t i = 0; i < skeleton.interfaces.size(); ++i) {
+        out->append(i == 0 ? "" : ",").append(skeleton.interfaces[i]);
+    }
+    out->append("\n");
+}
@@ -0,0 +1,34 @@
+//
+// Formats dump records as dump.cs text. Pure functions of the records, so the same output is
+// produced in the game process and in the companion.
+//
+
+#ifndef ZYGISK_IL2CPPDUMPER_DUMP_FORMAT_H
+#define ZYGISK_IL2CPPDUMPER_DUMP_FORMAT_H
+
+#include <string>
+#include "dump_record.h"
+
+std::string get_method_modifier(uint32_t flags);
+
+// "// Image <index>: <name>" line of the dump.cs header.
+void format_image(uint32_t index, const std::string &image_name, std::string *out);
+
+// Namespace.Type, or Declaring.Type for nested types, as used by the symbol files.
+std::string format_full_name(const TypeRecord &type);
+
+// A full type block, preceded by its "// Dll : <image>" line. Without with_va, method lines only
+// carry the RVA, so the text does not depend on where libil2cpp.so was loaded.
+void format_type(const TypeRecord &type, const std::string &image_name, std::string *out, bool with_va = true);
+
+// Copies text formatted without VAs to out, adding "VA: 0x<base + RVA>" to every method line.
+void format_add_va(const char *text, size_t size, uint64_t base, std::string *out);
+
+// Header line of the type index (dump_types.tsv) written by the staged mode's first stage.
+void format_skeleton_header(std::string *out);
+
+// One tab-separated line: image, token, flags, namespace, name, parent, interfaces. Nested types are
+// named "Outer/Inner" under their outermost type's namespace; parent and interfaces are full names.
+void format_skeleton(const SkeletonRecord &skeleton, const std::string &image_name, std::string *out);
+
+#endif //ZYGISK_IL2CPPDUMPER_DUMP_FORMAT_H
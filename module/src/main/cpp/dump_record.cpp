@@ -0,0 +1,264 @@
+//
+// Binary serialization of dump records.
+//
+
+#include "dump_record.h"
+
+void RecordWriter::begin(RecordKind kind) {
+    frame = out->size();
+    u32(0);
+    u8(kind);
+}
+
+void RecordWriter::end() {
+    auto length = (uint32_t) (out->size() - frame - sizeof(uint32_t) - 1);
+    for (int i = 0; i < 4; ++i) {
+        (*out)[frame + i] = (char) (length >> (i * 8));
+    }
+}
+
+void RecordWriter::u8(uint8_t value) {
+    out->push_back((char) value);
+}
+
+void RecordWriter::u32(uint32_t value) {
+    char bytes[4];
+    for (int i = 0; i < 4; ++i) {
+        bytes[i] = (char) (value >> (i * 8));
+    }
+    out->append(bytes, sizeof(bytes));
+}
+
+void RecordWriter::u64(uint64_t value) {
+    u32((uint32_t) value);
+    u32((uint32_t) (value >> 32));
+}
+
+void RecordWriter::str(const std::string &value) {
+    u32((uint32_t) value.size());
+    out->append(value);
+}
+
+bool RecordReader::u8(uint8_t *value) {
+    if (size - pos < 1) {
+        return false;
+    }
+    *value = (uint8_t) data[pos++];
+    return true;
+}
+
+bool RecordReader::u32(uint32_t *value) {
+    if (size - pos < 4) {
+        return false;
+    }
+    uint32_t result = 0;
+    for (int i = 0; i < 4; ++i) {
+        result |= (uint32_t) (uint8_t) data[pos + i] << (i * 8);
+    }
+    pos += 4;
+    *value = result;
+    return true;
+}
+
+bool RecordReader::u64(uint64_t *value) {
+    uint32_t low, high;
+    if (!u32(&low) || !u32(&high)) {
+        return false;
+    }
+    *value = (uint64_t) high << 32 | low;
+    return true;
+}
+
+bool RecordReader::str(std::string *value) {
+    uint32_t length;
+    if (!u32(&length) || size - pos < length) {
+        return false;
+    }
+    value->assign(data + pos, length);
+    pos += length;
+    return true;
+}
+
+static void write_names(RecordWriter &writer, const std::vector<std::string> &names) {
+    writer.u32((uint32_t) names.size());
+    for (auto &name: names) {
+        writer.str(name);
+    }
+}
+
+void record_write_type(RecordWriter &writer, const TypeRecord &type, bool portable) {
+    writer.begin(RECORD_TYPE);
+    writer.u32(portable ? 0 : type.image_index);
+    writer.u32(type.flags);
+    writer.u8(type.is_valuetype | type.is_enum << 1);
+    writer.str(type.namespaze);
+    writer.str(type.name);
+    writer.str(type.declaring_type);
+    write_names(writer, type.extends);
+    write_names(writer, type.attributes);
+    writer.u32((uint32_t) type.fields.size());
+    for (auto &field: type.fields) {
+        writer.u32(field.flags);
+        writer.u8(field.has_value);
+        writer.u64(field.value);
+        writer.u64(field.offset);
+        writer.str(field.type_name);
+        writer.str(field.name);
+        write_names(writer, field.attributes);
+    }
+    writer.u32((uint32_t) type.properties.size());
+    for (auto &property: type.properties) {
+        writer.u32(property.accessor_flags);
+        writer.u8(property.has_get | property.has_set << 1 | property.known << 2);
+        writer.str(property.type_name);
+        writer.str(property.name);
+    }
+    writer.u32((uint32_t) type.methods.size());
+    for (auto &method: type.methods) {
+        writer.u64(method.rva);
+        writer.u64(portable ? method.va != 0 : method.va);
+        writer.u32(method.flags);
+        writer.u8(method.return_byref);
+        writer.str(method.return_type);
+        writer.str(method.name);
+        writer.u32((uint32_t) method.params.size());
+        for (auto &param: method.params) {
+            writer.u32(param.attrs);
+            writer.u8(param.byref);
+            writer.str(param.type_name);
+            writer.str(param.name);
+        }
+        write_names(writer, method.attributes);
+    }
+    writer.u32((uint32_t) type.events.size());
+    for (auto &event: type.events) {
+        writer.u32(event.accessor_flags);
+        writer.str(event.type_name);
+        writer.str(event.name);
+    }
+    write_names(writer, type.nested_types);
+    writer.end();
+}
+
+// Element counts come from the peer; never allocate more elements than the rest of the payload
+// could hold, given the smallest serialized size of one element.
+template<typename T>
+static bool read_count(RecordReader &reader, std::vector<T> *items, size_t min_size) {
+    uint32_t count;
+    if (!reader.u32(&count) || count > reader.remaining() / min_size) {
+        return false;
+    }
+    items->resize(count);
+    return true;
+}
+
+static bool read_names(RecordReader &reader, std::vector<std::string> *names) {
+    if (!read_count(reader, names, 4)) {
+        return false;
+    }
+    for (auto &name: *names) {
+        if (!reader.str(&name)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool record_read_type(RecordReader &reader, TypeRecord *type) {
+    uint8_t bits;
+    if (!reader.u32(&type->image_index) || !reader.u32(&type->flags) || !reader.u8(&bits) ||
+        !reader.str(&type->namespaze) || !reader.str(&type->name) || !reader.str(&type->declaring_type)) {
+        return false;
+    }
+    type->is_valuetype = bits & 1;
+    type->is_enum = bits & 2;
+    if (!read_names(reader, &type->extends) || !read_names(reader, &type->attributes) ||
+        !read_count(reader, &type->fields, 33)) {
+        return false;
+    }
+    for (auto &field: type->fields) {
+        if (!reader.u32(&field.flags) || !reader.u8(&bits) || !reader.u64(&field.value) ||
+            !reader.u64(&field.offset) || !reader.str(&field.type_name) || !reader.str(&field.name) ||
+            !read_names(reader, &field.attributes)) {
+            return false;
+        }
+        field.has_value = bits & 1;
+    }
+    if (!read_count(reader, &type->properties, 13)) {
+        return false;
+    }
+    for (auto &property: type->properties) {
+        if (!reader.u32(&property.accessor_flags) || !reader.u8(&bits) ||
+            !reader.str(&property.type_name) || !reader.str(&property.name)) {
+            return false;
+        }
+        property.has_get = bits & 1;
+        property.has_set = bits & 2;
+        property.known = bits & 4;
+    }
+    if (!read_count(reader, &type->methods, 37)) {
+        return false;
+    }
+    for (auto &method: type->methods) {
+        if (!reader.u64(&method.rva) || !reader.u64(&method.va) || !reader.u32(&method.flags) ||
+            !reader.u8(&bits) || !reader.str(&method.return_type) || !reader.str(&method.name) ||
+            !read_count(reader, &method.params, 13)) {
+            return false;
+        }
+        method.return_byref = bits & 1;
+        for (auto &param: method.params) {
+            if (!reader.u32(&param.attrs) || !reader.u8(&bits) || !reader.str(&param.type_name) ||
+                !reader.str(&param.name)) {
+                return false;
+            }
+            param.byref = bits & 1;
+        }
+        if (!read_names(reader, &method.attributes)) {
+            return false;
+        }
+    }
+    if (!read_count(reader, &type->events, 12)) {
+        return false;
+    }
+    for (auto &event: type->events) {
+        if (!reader.u32(&event.accessor_flags) || !reader.str(&event.type_name) || !reader.str(&event.name)) {
+            return false;
+        }
+    }
+    return read_names(reader, &type->nested_types);
+}
+
+void record_write_skeleton(RecordWriter &writer, const SkeletonRecord &skeleton) {
+    writer.begin(RECORD_SKELETON);
+    writer.u32(skeleton.image_index);
+    writer.u32(skeleton.token);
+    writer.u32(skeleton.flags);
+    writer.str(skeleton.namespaze);
+    writer.str(skeleton.name);
+    writer.str(skeleton.parent);
+    write_names(writer, skeleton.interfaces);
+    writer.end();
+}
+
+bool record_read_skeleton(RecordReader &reader, SkeletonRecord *skeleton) {
+    if (!reader.u32(&skeleton->image_index) || !reader.u32(&skeleton->token) || !reader.u32(&skeleton->flags) ||
+        !reader.str(&skeleton->namespaze) || !reader.str(&skeleton->name) || !reader.str(&skeleton->parent) ||
+        !read_names(reader, &skeleton->interfaces)) {
+        return false;
+    }
+    return true;
+}
+
+void record_write_code_info(RecordWriter &writer, const CodeInfo &code) {
+    writer.u64(code.base);
+    writer.u64(code.code_start);
+    writer.u64(code.code_end);
+    writer.u32(code.machine);
+    writer.u8(code.elf_class);
+    writer.str(code.build_id);
+}
+
+bool record_read_code_info(RecordReader &reader, CodeInfo *code) {
+    return reader.u64(&code->base) && reader.u64(&code->code_start) && reader.u64(&code->code_end) &&
+           reader.u32(&code->machine) && reader.u8(&code->elf_class) && reader.str(&code->build_id);
+}
@@ -0,0 +1,174 @@
+//
+// Structured dump records: what il2cpp_dump collects for each type, independent of how it is
+// formatted or where it is written. Records are serialized into a compact little-endian binary
+// stream so they can be formatted out of process by the companion.
+//
+
+#ifndef ZYGISK_IL2CPPDUMPER_DUMP_RECORD_H
+#define ZYGISK_IL2CPPDUMPER_DUMP_RECORD_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+struct ParamRecord {
+    uint32_t attrs;
+    bool byref;
+    std::string type_name;
+    std::string name;
+};
+
+struct MethodRecord {
+    uint64_t rva;
+    uint64_t va;    // 0 when the method has no compiled body
+    uint32_t flags;
+    bool return_byref;
+    std::string return_type;
+    std::string name;
+    std::vector<ParamRecord> params;
+    std::vector<std::string> attributes; // attribute class names, without the "Attribute" suffix
+};
+
+struct FieldRecord {
+    uint32_t flags;
+    bool has_value; // enum literal whose value was read
+    uint64_t value;
+    uint64_t offset;
+    std::string type_name;
+    std::string name;
+    std::vector<std::string> attributes;
+};
+
+struct PropertyRecord {
+    uint32_t accessor_flags; // flags of the getter, or of the setter when there is no getter
+    bool has_get;
+    bool has_set;
+    bool known;              // false when the property type could not be resolved
+    std::string type_name;
+    std::string name;
+};
+
+struct EventRecord {
+    uint32_t accessor_flags; // flags of the add method, or of remove when there is no add
+    std::string type_name;
+    std::string name;
+};
+
+struct TypeRecord {
+    uint32_t image_index;
+    uint32_t flags;
+    bool is_valuetype;
+    bool is_enum;
+    std::string namespaze;
+    std::string name;
+    std::string declaring_type;            // full name of the enclosing type, empty unless nested
+    std::vector<std::string> extends;
+    std::vector<std::string> attributes;
+    std::vector<FieldRecord> fields;
+    std::vector<PropertyRecord> properties;
+    std::vector<MethodRecord> methods;
+    std::vector<EventRecord> events;
+    std::vector<std::string> nested_types; // names of the types declared inside this one
+};
+
+// libil2cpp.so as loaded in the game, for the symbol files built from the records.
+struct CodeInfo {
+    uint64_t base = 0;       // load bias
+    uint64_t code_start = 0; // executable segment, as VAs; both 0 when unknown
+    uint64_t code_end = 0;
+    uint32_t machine = 0;    // e_machine
+    uint8_t elf_class = 0;   // ELFCLASS32 or ELFCLASS64
+    std::string build_id;    // hex NT_GNU_BUILD_ID, empty if the library has none
+};
+
+// Lightweight per-class entry of the staged mode's first stage (the type index).
+struct SkeletonRecord {
+    uint32_t image_index;
+    uint32_t token;
+    uint32_t flags;
+    std::string namespaze;   // of the outermost declaring type for nested types
+    std::string name;        // "Outer/Inner" for nested types
+    std::string parent;      // "Namespace.Outer/Inner", empty for System.Object and interfaces
+    std::vector<std::string> interfaces; // qualified like parent
+};
+
+// Message kinds of the record stream. Every message is framed as
+// [u32 payload length][u8 kind][payload].
+enum RecordKind : uint8_t {
+    RECORD_HELLO = 1, // u32 protocol version, u32 flags, str package name, i32 I/O priority, CodeInfo
+    RECORD_IMAGE = 2, // u32 index, str name
+    RECORD_TYPE = 3,  // TypeRecord
+    RECORD_END = 4,   // u32 type count
+    RECORD_SKELETON = 5,     // SkeletonRecord, staged mode only, all before the first RECORD_TYPE
+    RECORD_SKELETON_END = 6, // u32 skeleton count
+};
+
+static constexpr uint32_t kRecordProtocolVersion = 6;
+static constexpr uint32_t kRecordFlagCompress = 1u << 0;
+static constexpr uint32_t kRecordFlagStore = 1u << 1;    // go through the content-addressed store
+static constexpr uint32_t kRecordFlagPerfMap = 1u << 2;  // write perf-<pid>.map
+static constexpr uint32_t kRecordFlagElfSymbols = 1u << 3; // write libil2cpp.so.debug
+// Upper bound for a single message, so a corrupt length never turns into a huge allocation.
+static constexpr uint32_t kRecordMaxPayload = 64 * 1024 * 1024;
+
+class RecordWriter {
+public:
+    explicit RecordWriter(std::string *out) : out(out) {}
+
+    void begin(RecordKind kind);
+
+    void end();
+
+    void u8(uint8_t value);
+
+    void u32(uint32_t value);
+
+    void u64(uint64_t value);
+
+    void str(const std::string &value);
+
+private:
+    std::string *out;
+    size_t frame = 0;
+};
+
+class RecordReader {
+public:
+    RecordReader(const char *data, size_t size) : data(data), size(size) {}
+
+    bool u8(uint8_t *value);
+
+    bool u32(uint32_t *value);
+
+    bool u64(uint64_t *value);
+
+    bool str(std::string *value);
+
+    size_t remaining() const { return size - pos; }
+
+    bool done() const { return pos == size; }
+
+private:
+    const char *data;
+    size_t size;
+    size_t pos = 0;
+};
+
+// With portable set, the image index and the method VAs are left out (a VA is written as 1 when the
+// method has a body), so the bytes only depend on the type itself, not on the image order or on
+// where libil2cpp.so was loaded. The content-addressed store hashes this form.
+void record_write_type(RecordWriter &writer, const TypeRecord &type, bool portable = false);
+
+bool record_read_type(RecordReader &reader, TypeRecord *type);
+
+void record_write_skeleton(RecordWriter &writer, const SkeletonRecord &skeleton);
+
+bool record_read_skeleton(RecordReader &reader, SkeletonRecord *skeleton);
+
+// Part of RECORD_HELLO, not a message of its own.
+void record_write_code_info(RecordWriter &writer, const CodeInfo &code);
+
+bool record_read_code_info(RecordReader &reader, CodeInfo *code);
+
+#endif //ZYGISK_IL2CPPDUMPER_DUMP_RECORD_H
@@ -0,0 +1,295 @@
+//
+// Destinations for the records collected by il2cpp_dump.
+//
+
+#include "dump_sink.h"
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include "companion.h"
+#include "dump_format.h"
+#include "dump_store.h"
+#include "log.h"
+#include "method_symbols.h"
+#include "stats.h"
+
+// Formatted text or serialized records are handed to the file/socket in chunks of this size, so
+// memory use stays bounded no matter how large the dump is.
+static constexpr size_t kSinkBufferSize = 64 * 1024;
+// How long to wait for the companion to confirm that the dump was written.
+static constexpr int kCompanionAckTimeoutSec = 60;
+
+class LocalSink : public DumpSink {
+public:
+    LocalSink(const char *game_data_dir, const DumperConfig &config)
+            : path(std::string(game_data_dir).append("/files/dump.cs")),
+              skeleton_path(std::string(game_data_dir).append("/files/dump_types.tsv")),
+              perf_map_fallback_path(std::string(game_data_dir).append("/files/perf-").append(
+                      std::to_string(getpid())).append(".map")),
+              elf_symbols_path(std::string(game_data_dir).append("/files/libil2cpp.so.debug")),
+              package(config.package_name), perf_map(config.perf_map), elf_symbols(config.elf_symbols) {
+        if (config.store) {
+            store = std::make_unique<DumpStore>(std::string(game_data_dir).append("/files/store"));
+            if (!store->open()) {
+                store.reset();
+            }
+        }
+    }
+
+    ~LocalSink() override {
+        if (file) {
+            fclose(file);
+        }
+        if (skeleton_file) {
+            fclose(skeleton_file);
+        }
+    }
+
+    const char *name() const override {
+        return "local";
+    }
+
+    bool begin(const std::vector<std::string> &image_names, const CodeInfo &code_info) override {
+        file = fopen(path.c_str(), "w");
+        if (!file) {
+            LOGE("Unable to open %s: %s", path.c_str(), strerror(errno));
+            return false;
+        }
+        images = image_names;
+        code = code_info;
+        for (size_t i = 0; i < images.size(); ++i) {
+            format_image((uint32_t) i, images[i], &buffer);
+        }
+        if (store) {
+            formatter = std::make_unique<StoreFormatter>(*store, images, package, code.base,
+                                                         [this](const std::string &text) {
+                buffer.append(text);
+                return buffer.size() < kSinkBufferSize || flush();
+            });
+        }
+        return true;
+    }
+
+    bool write_skeleton(const SkeletonRecord &skeleton) override {
+        if (!skeleton_file) {
+            skeleton_file = fopen(skeleton_path.c_str(), "w");
+            if (!skeleton_file) {
+                LOGE("Unable to open %s: %s", skeleton_path.c_str(), strerror(errno));
+                return false;
+            }
+            format_skeleton_header(&skeleton_buffer);
+        }
+        format_skeleton(skeleton, images[skeleton.image_index], &skeleton_buffer);
+        return skeleton_buffer.size() < kSinkBufferSize || flush_skeleton();
+    }
+
+    bool finish_skeleton() override {
+        if (!skeleton_file) {
+            return true;
+        }
+        auto ok = flush_skeleton();
+        ok = fclose(skeleton_file) == 0 && ok;
+        skeleton_file = nullptr;
+        return ok;
+    }
+
+    bool write_type(const TypeRecord &type) override {
+        if (formatter) {
+            if (!formatter->add(type)) {
+                return false;
+            }
+        } else {
+            format_type(type, images[type.image_index], &buffer);
+        }
+        return buffer.size() < kSinkBufferSize || flush();
+    }
+
+    bool finish() override {
+        if (formatter && !formatter->finish()) {
+            return false;
+        }
+        if (store) {
+            stats_record("store_images_reused", "%u", store->reused);
+            stats_record("store_images_stored", "%u", store->stored);
+            stats_record("store_images_deduplicated", "%u", store->deduplicated);
+        }
+        auto ok = flush();
+        ok = fclose(file) == 0 && ok;
+        file = nullptr;
+        return ok;
+    }
+
+    bool wants_method_index() const override {
+        return perf_map || elf_symbols;
+    }
+
+    void write_symbols(const MethodIndex &index) override {
+        MethodSymbols symbols(index, code);
+        stats_record("symbol_methods", "%zu", symbols.size());
+        // /data/local/tmp is usually not writable by apps, files/ is the fallback.
+        auto perf_path = perf_map_path(getpid());
+        if (perf_map && (symbols.write_perf_map(perf_path) ||
+                         symbols.write_perf_map(perf_path = perf_map_fallback_path))) {
+            LOGI("perf map: %zu methods -> %s", symbols.size(), perf_path.c_str());
+        }
+        if (elf_symbols && symbols.write_elf(elf_symbols_path)) {
+            LOGI("symbol file: %zu methods -> %s", symbols.size(), elf_symbols_path.c_str());
+        }
+    }
+
+private:
+
+    bool flush() {
+        auto ok = fwrite(buffer.data(), 1, buffer.size(), file) == buffer.size();
+        buffer.clear();
+        return ok;
+    }
+
+    bool flush_skeleton() {
+        auto ok = fwrite(skeleton_buffer.data(), 1, skeleton_buffer.size(), skeleton_file) == skeleton_buffer.size();
+        skeleton_buffer.clear();
+        return ok;
+    }
+
+    std::string path;
+    std::string skeleton_path;
+    std::string perf_map_fallback_path;
+    std::string elf_symbols_path;
+    std::string skeleton_buffer;
+    FILE *skeleton_file = nullptr;
+    std::string package;
+    std::vector<std::string> images;
+    std::string buffer;
+    std::unique_ptr<DumpStore> store;
+    std::unique_ptr<StoreFormatter> formatter;
+    bool perf_map;
+    bool elf_symbols;
+    CodeInfo code;
+    FILE *file = nullptr;
+};
+
+class CompanionSink : public DumpSink {
+public:
+    CompanionSink(int fd, const DumperConfig &config) : fd(fd), writer(&buffer), config(config) {}
+
+    ~CompanionSink() override {
+        close(fd);
+    }
+
+    const char *name() const override {
+        return "companion";
+    }
+
+    bool begin(const std::vector<std::string> &image_names, const CodeInfo &code) override {
+        writer.begin(RECORD_HELLO);
+        writer.u32(kRecordProtocolVersion);
+        writer.u32((config.compress ? kRecordFlagCompress : 0) | (config.store ? kRecordFlagStore : 0) |
+                   (config.perf_map ? kRecordFlagPerfMap : 0) | (config.elf_symbols ? kRecordFlagElfSymbols : 0));
+        writer.str(config.package_name);
+        writer.u32((uint32_t) config.io_priority);
+        record_write_code_info(writer, code);
+        writer.end();
+        for (size_t i = 0; i < image_names.size(); ++i) {
+            writer.begin(RECORD_IMAGE);
+            writer.u32((uint32_t) i);
+            writer.str(image_names[i]);
+            writer.end();
+        }
+        return flush();
+    }
+
+    bool write_skeleton(const SkeletonRecord &skeleton) override {
+        record_write_skeleton(writer, skeleton);
+        skeletons++;
+        return buffer.size() < kSinkBufferSize || flush();
+    }
+
+    // Flushed right away: the companion commits dump_types.tsv as soon as it sees the end marker.
+    bool finish_skeleton() override {
+        writer.begin(RECORD_SKELETON_END);
+        writer.u32(skeletons);
+        writer.end();
+        return flush();
+    }
+
+    bool write_type(const TypeRecord &type) override {
+        record_write_type(writer, type);
+        types++;
+        return buffer.size() < kSinkBufferSize || flush();
+    }
+
+    bool finish() override {
+        writer.begin(RECORD_END);
+        writer.u32(types);
+        writer.end();
+        if (!flush()) {
+            return false;
+        }
+        // The companion answers once the output file is complete.
+        timeval timeout{kCompanionAckTimeoutSec, 0};
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        uint8_t status = 0;
+        if (read(fd, &status, sizeof(status)) != sizeof(status) || status != 1) {
+            LOGE("Companion did not confirm the dump");
+            return false;
+        }
+        stats_record("dump_companion_bytes", "%llu", (unsigned long long) sent);
+        LOGI("dump written by companion to %s/%s", COMPANION_OUTPUT_DIR, config.package_name);
+        return true;
+    }
+
+    // The companion builds its own index from the records it receives.
+    bool wants_method_index() const override {
+        return false;
+    }
+
+    void write_symbols(const MethodIndex &) override {}
+
+private:
+    // send() blocks while the socket buffer is full, which throttles the dump to the companion's pace.
+    bool flush() {
+        auto ptr = buffer.data();
+        auto length = buffer.size();
+        while (length > 0) {
+            auto n = send(fd, ptr, length, MSG_NOSIGNAL);
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n <= 0) {
+                LOGE("send to companion failed: %s", strerror(errno));
+                return false;
+            }
+            ptr += n;
+            length -= (size_t) n;
+        }
+        sent += buffer.size();
+        buffer.clear();
+        return true;
+    }
+
+    int fd;
+    std::string buffer;
+    RecordWriter writer;
+    DumperConfig config;
+    uint32_t types = 0;
+    uint32_t skeletons = 0;
+    uint64_t sent = 0;
+};
+
+std::unique_ptr<DumpSink> dump_sink_local(const char *game_data_dir, const DumperConfig &config) {
+    return std::make_unique<LocalSink>(game_data_dir, config);
+}
+
+std::unique_ptr<DumpSink> dump_sink_companion(const DumperConfig &config) {
+    if (!config.companion) {
+        return nullptr;
+    }
+    auto fd = companion_connect();
+    if (fd == -1) {
+        return nullptr;
+    }
+    return std::make_unique<CompanionSink>(fd, config);
+}
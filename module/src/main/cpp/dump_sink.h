@@ -0,0 +1,49 @@
+//
+// Destinations for the records collected by il2cpp_dump: formatted locally into
+// <game_data_dir>/files/dump.cs (and dump_types.tsv in staged mode), or streamed to the root companion.
+//
+
+#ifndef ZYGISK_IL2CPPDUMPER_DUMP_SINK_H
+#define ZYGISK_IL2CPPDUMPER_DUMP_SINK_H
+
+#include <memory>
+#include <string>
+#include <vector>
+#include "config.h"
+#include "dump_record.h"
+#include "method_index.h"
+
+class DumpSink {
+public:
+    virtual ~DumpSink() = default;
+
+    virtual const char *name() const = 0;
+
+    // code describes libil2cpp.so for the perf map and the ELF symbol file.
+    virtual bool begin(const std::vector<std::string> &image_names, const CodeInfo &code) = 0;
+
+    // Staged mode: the type index is written and closed before the first write_type, so it can be
+    // used while the full dump is still running.
+    virtual bool write_skeleton(const SkeletonRecord &skeleton) = 0;
+
+    virtual bool finish_skeleton() = 0;
+
+    virtual bool write_type(const TypeRecord &type) = 0;
+
+    // Completes the dump. Returns false if any part of it was lost.
+    virtual bool finish() = 0;
+
+    // Whether write_symbols needs the MethodIndex of the dump. il2cpp_dump then fills one index for
+    // the sink, the method index files and the symbolizer alike.
+    virtual bool wants_method_index() const = 0;
+
+    // After finish, with that index built: writes the perf map and the ELF symbol file.
+    virtual void write_symbols(const MethodIndex &index) = 0;
+};
+
+std::unique_ptr<DumpSink> dump_sink_local(const char *game_data_dir, const DumperConfig &config);
+
+// Returns nullptr when the companion is disabled in config or not reachable.
+std::unique_ptr<DumpSink> dump_sink_companion(const DumperConfig &config);
+
+#endif //ZYGISK_IL2CPPDUMPER_DUMP_SINK_H
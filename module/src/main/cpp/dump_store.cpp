@@ -0,0 +1,417 @@
+//
+// Content-addressed store for formatted dump output, shared across games and runs.
+//
+
+#include "dump_store.h"
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <vector>
+#include "dump_format.h"
+#include "dump_record.h"
+#include "log.h"
+
+static inline uint64_t rotl64(uint64_t x, int r) {
+    return (x << r) | (x >> (64 - r));
+}
+
+static inline uint64_t fmix64(uint64_t k) {
+    k ^= k >> 33;
+    k *= 0xff51afd7ed558ccdULL;
+    k ^= k >> 33;
+    k *= 0xc4ceb9fe1a85ec53ULL;
+    k ^= k >> 33;
+    return k;
+}
+
+static constexpr uint64_t kMurmurC1 = 0x87c37b91114253d5ULL;
+static constexpr uint64_t kMurmurC2 = 0x4cf5ad432745937fULL;
+// Formatted text and spilled records move through memory in chunks of this size.
+static constexpr size_t kStoreChunk = 64 * 1024;
+
+void Hasher128::block(const uint8_t *data) {
+    uint64_t k1, k2;
+    memcpy(&k1, data, 8);
+    memcpy(&k2, data + 8, 8);
+    k1 *= kMurmurC1;
+    k1 = rotl64(k1, 31);
+    k1 *= kMurmurC2;
+    h1 ^= k1;
+    h1 = rotl64(h1, 27);
+    h1 += h2;
+    h1 = h1 * 5 + 0x52dce729;
+    k2 *= kMurmurC2;
+    k2 = rotl64(k2, 33);
+    k2 *= kMurmurC1;
+    h2 ^= k2;
+    h2 = rotl64(h2, 31);
+    h2 += h1;
+    h2 = h2 * 5 + 0x38495ab5;
+}
+
+void Hasher128::update(const void *data, size_t size) {
+    auto bytes = (const uint8_t *) data;
+    length += size;
+    if (tail_size) {
+        auto n = std::min(size, sizeof(tail) - tail_size);
+        memcpy(tail + tail_size, bytes, n);
+        tail_size += n;
+        bytes += n;
+        size -= n;
+        if (tail_size < sizeof(tail)) {
+            return;
+        }
+        block(tail);
+        tail_size = 0;
+    }
+    for (; size >= 16; bytes += 16, size -= 16) {
+        block(bytes);
+    }
+    memcpy(tail, bytes, size);
+    tail_size = size;
+}
+
+Hash128 Hasher128::final() const {
+    auto h1 = this->h1, h2 = this->h2;
+    uint64_t k1 = 0, k2 = 0;
+    switch (tail_size) {
+        case 15: k2 ^= (uint64_t) tail[14] << 48; [[fallthrough]];
+        case 14: k2 ^= (uint64_t) tail[13] << 40; [[fallthrough]];
+        case 13: k2 ^= (uint64_t) tail[12] << 32; [[fallthrough]];
+        case 12: k2 ^= (uint64_t) tail[11] << 24; [[fallthrough]];
+        case 11: k2 ^= (uint64_t) tail[10] << 16; [[fallthrough]];
+        case 10: k2 ^= (uint64_t) tail[9] << 8; [[fallthrough]];
+        case 9:
+            k2 ^= (uint64_t) tail[8];
+            k2 *= kMurmurC2;
+            k2 = rotl64(k2, 33);
+            k2 *= kMurmurC1;
+            h2 ^= k2;
+            [[fallthrough]];
+        case 8: k1 ^= (uint64_t) tail[7] << 56; [[fallthrough]];
+        case 7: k1 ^= (uint64_t) tail[6] << 48; [[fallthrough]];
+        case 6: k1 ^= (uint64_t) tail[5] << 40; [[fallthrough]];
+        case 5: k1 ^= (uint64_t) tail[4] << 32; [[fallthrough]];
+        case 4: k1 ^= (uint64_t) tail[3] << 24; [[fallthrough]];
+        case 3: k1 ^= (uint64_t) tail[2] << 16; [[fallthrough]];
+        case 2: k1 ^= (uint64_t) tail[1] << 8; [[fallthrough]];
+        case 1:
+            k1 ^= (uint64_t) tail[0];
+            k1 *= kMurmurC1;
+            k1 = rotl64(k1, 31);
+            k1 *= kMurmurC2;
+            h1 ^= k1;
+            break;
+        default:
+            break;
+    }
+    h1 ^= length;
+    h2 ^= length;
+    h1 += h2;
+    h2 += h1;
+    h1 = fmix64(h1);
+    h2 = fmix64(h2);
+    h1 += h2;
+    h2 += h1;
+    return {h1, h2};
+}
+
+Hash128 hash128(const void *data, size_t size) {
+    Hasher128 hasher;
+    hasher.update(data, size);
+    return hasher.final();
+}
+
+std::string Hash128::hex() const {
+    char buf[33];
+    snprintf(buf, sizeof(buf), "%016llx%016llx", (unsigned long long) high, (unsigned long long) low);
+    return buf;
+}
+
+static bool read_file(const std::string &path, std::string *text) {
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        return false;
+    }
+    text->clear();
+    char buf[64 * 1024];
+    ssize_t n;
+    while ((n = read(fd, buf, sizeof(buf))) > 0) {
+        text->append(buf, (size_t) n);
+    }
+    close(fd);
+    return n == 0;
+}
+
+bool DumpStore::open() {
+    for (auto dir: {"", "/objects", "/index", "/manifests"}) {
+        auto path = root + dir;
+        if (mkdir(path.c_str(), 0755) != 0 && errno != EEXIST) {
+            LOGE("store: mkdir %s failed: %s", path.c_str(), strerror(errno));
+            return false;
+        }
+    }
+    return true;
+}
+
+std::string DumpStore::object_path(const Hash128 &content) const {
+    auto hex = content.hex();
+    return root + "/objects/" + hex.substr(0, 2) + "/" + hex;
+}
+
+bool DumpStore::write_file(const std::string &path, const std::string &text) {
+    char suffix[32];
+    snprintf(suffix, sizeof(suffix), ".tmp%d", gettid());
+    auto tmp_path = path + suffix;
+    auto file = fopen(tmp_path.c_str(), "w");
+    if (!file) {
+        LOGE("store: unable to open %s: %s", tmp_path.c_str(), strerror(errno));
+        return false;
+    }
+    auto ok = fwrite(text.data(), 1, text.size(), file) == text.size();
+    ok = fclose(file) == 0 && ok;
+    if (!ok || rename(tmp_path.c_str(), path.c_str()) != 0) {
+        LOGE("store: unable to write %s: %s", path.c_str(), strerror(errno));
+        unlink(tmp_path.c_str());
+        return false;
+    }
+    chmod(path.c_str(), 0644);
+    return true;
+}
+
+bool DumpStore::lookup(const Hash128 &records, Hash128 *content) {
+    std::string text;
+    if (!read_file(root + "/index/" + records.hex(), &text) || text.size() < 32) {
+        return false;
+    }
+    unsigned long long high, low;
+    if (sscanf(text.c_str(), "%16llx%16llx", &high, &low) != 2) {
+        return false;
+    }
+    *content = {low, high};
+    return access(object_path(*content).c_str(), F_OK) == 0;
+}
+
+FILE *DumpStore::open_object(const Hash128 &content) {
+    return fopen(object_path(content).c_str(), "re");
+}
+
+std::string DumpStore::temp_path(const char *name) const {
+    char suffix[32];
+    snprintf(suffix, sizeof(suffix), ".tmp%d", gettid());
+    return root + "/" + name + suffix;
+}
+
+bool DumpStore::commit(const Hash128 &records, const Hash128 &content, const std::string &path) {
+    auto object = object_path(content);
+    if (access(object.c_str(), F_OK) == 0) {
+        unlink(path.c_str());
+        deduplicated++;
+    } else {
+        auto dir = object.substr(0, object.rfind('/'));
+        if ((mkdir(dir.c_str(), 0755) != 0 && errno != EEXIST) || rename(path.c_str(), object.c_str()) != 0) {
+            LOGE("store: unable to write %s: %s", object.c_str(), strerror(errno));
+            unlink(path.c_str());
+            return false;
+        }
+        chmod(object.c_str(), 0644);
+        stored++;
+    }
+    return write_file(root + "/index/" + records.hex(), content.hex() + "\n");
+}
+
+bool DumpStore::write_manifest(const std::string &package, const std::string &text) {
+    // Fixed-width seconds sort the names by time; nanoseconds and the pid keep runs apart.
+    timespec now{};
+    clock_gettime(CLOCK_REALTIME, &now);
+    char name[320];
+    snprintf(name, sizeof(name), "%s-%010lld.%09ld-%d.txt", package.c_str(), (long long) now.tv_sec, now.tv_nsec,
+             getpid());
+    auto dir = root + "/manifests/";
+    if (!write_file(dir + name, text)) {
+        return false;
+    }
+    auto prefix = package + "-";
+    std::vector<std::string> names;
+    if (auto entries = opendir(dir.c_str())) {
+        while (auto entry = readdir(entries)) {
+            // "<package>-<digit>": a package named like another one's prefix is not matched.
+            if (strncmp(entry->d_name, prefix.c_str(), prefix.size()) == 0 &&
+                entry->d_name[prefix.size()] >= '0' && entry->d_name[prefix.size()] <= '9') {
+                names.emplace_back(entry->d_name);
+            }
+        }
+        closedir(entries);
+    }
+    if (names.size() > kStoreManifestsKept) {
+        std::sort(names.begin(), names.end());
+        for (size_t i = 0; i + kStoreManifestsKept < names.size(); ++i) {
+            unlink((dir + names[i]).c_str());
+        }
+    }
+    return true;
+}
+
+StoreFormatter::StoreFormatter(DumpStore &store, const std::vector<std::string> &images, const std::string &package,
+                               uint64_t base, std::function<bool(const std::string &)> output)
+        : store(store), images(images), package(package), base(base), output(std::move(output)) {
+    manifest.append("# Il2CppDumper manifest v1\npackage ").append(package).append("\n");
+}
+
+StoreFormatter::~StoreFormatter() {
+    if (spill) {
+        fclose(spill);
+    }
+}
+
+bool StoreFormatter::add(const TypeRecord &type) {
+    if (type.image_index != current) {
+        if (!flush()) {
+            return false;
+        }
+        current = type.image_index;
+    }
+    if (!spill) {
+        // Unlinked right away: nothing is left behind if the process dies mid-image.
+        auto path = store.temp_path("spill");
+        spill = fopen(path.c_str(), "w+e");
+        unlink(path.c_str());
+        if (!spill) {
+            LOGE("store: unable to open %s: %s", path.c_str(), strerror(errno));
+            return false;
+        }
+    }
+    record.clear();
+    RecordWriter writer(&record);
+    record_write_type(writer, type, true);
+    // The message header is left out of the hash, so type hashes stay those of the payload.
+    auto type_hash = hash128(record.data() + 5, record.size() - 5);
+    type_hashes.append((const char *) &type_hash, sizeof(type_hash));
+    type_lines.append("type ").append(type_hash.hex()).append(" ");
+    if (!type.namespaze.empty()) {
+        type_lines.append(type.namespaze).append(".");
+    }
+    type_lines.append(type.name).append("\n");
+    return fwrite(record.data(), 1, record.size(), spill) == record.size();
+}
+
+bool StoreFormatter::emit(const std::string &text) {
+    with_va.clear();
+    format_add_va(text.data(), text.size(), base, &with_va);
+    return output(with_va);
+}
+
+bool StoreFormatter::copy_object(FILE *object) {
+    // Chunks end on a line, so no method line is split between two of them.
+    chunk.clear();
+    char buffer[kStoreChunk];
+    size_t n;
+    auto ok = true;
+    while (ok && (n = fread(buffer, 1, sizeof(buffer), object)) > 0) {
+        chunk.append(buffer, n);
+        auto line_end = chunk.rfind('\n');
+        if (line_end != std::string::npos) {
+            auto rest = chunk.substr(line_end + 1);
+            chunk.resize(line_end + 1);
+            ok = emit(chunk);
+            chunk = std::move(rest);
+        }
+    }
+    ok = ok && !ferror(object) && (chunk.empty() || emit(chunk));
+    fclose(object);
+    return ok;
+}
+
+// Formats the spilled records of the current image to output and, when it can be opened, to the
+// object file at path. *complete tells whether that file holds the whole text.
+bool StoreFormatter::format_spilled(const std::string &image_name, const std::string &path, Hash128 *content,
+                                    bool *complete) {
+    auto object = fopen(path.c_str(), "we");
+    if (!object) {
+        LOGW("store: unable to open %s: %s", path.c_str(), strerror(errno));
+    }
+    Hasher128 hasher;
+    auto ok = fflush(spill) == 0 && fseek(spill, 0, SEEK_SET) == 0;
+    auto stored = object != nullptr;
+    auto write_chunk = [&]() {
+        hasher.update(chunk.data(), chunk.size());
+        stored = stored && fwrite(chunk.data(), 1, chunk.size(), object) == chunk.size();
+        ok = ok && emit(chunk);
+        chunk.clear();
+    };
+    TypeRecord type;
+    uint8_t header[5];
+    chunk.clear();
+    while (ok && fread(header, 1, sizeof(header), spill) == sizeof(header)) {
+        auto length = (uint32_t) header[0] | header[1] << 8 | header[2] << 16 | (uint32_t) header[3] << 24;
+        record.resize(length);
+        RecordReader reader(record.data(), record.size());
+        type = TypeRecord{};
+        if (fread(record.data(), 1, length, spill) != length || !record_read_type(reader, &type)) {
+            LOGE("store: spilled record of %s is unreadable", image_name.c_str());
+            ok = false;
+            break;
+        }
+        format_type(type, image_name, &chunk, false);
+        if (chunk.size() >= kStoreChunk) {
+            write_chunk();
+        }
+    }
+    write_chunk();
+    *content = hasher.final();
+    if (object) {
+        stored = fclose(object) == 0 && stored;
+    }
+    *complete = ok && stored;
+    if (object && !*complete) {
+        unlink(path.c_str());
+    }
+    return ok;
+}
+
+bool StoreFormatter::flush() {
+    if (current == UINT32_MAX || type_hashes.empty()) {
+        return true;
+    }
+    auto &image_name = images[current];
+    auto records_hash = hash128(type_hashes.data(), type_hashes.size());
+    Hash128 content_hash{};
+    FILE *object = nullptr;
+    if (store.lookup(records_hash, &content_hash) && (object = store.open_object(content_hash))) {
+        if (!copy_object(object)) {
+            return false;
+        }
+        store.reused++;
+    } else {
+        auto path = store.temp_path("object");
+        bool complete;
+        if (!format_spilled(image_name, path, &content_hash, &complete)) {
+            return false;
+        }
+        if (complete) {
+            store.commit(records_hash, content_hash, path);
+        }
+    }
+
+    char line[96];
+    snprintf(line, sizeof(line), "image %u %s %s ", current, content_hash.hex().c_str(), records_hash.hex().c_str());
+    manifest.append(line).append(image_name).append("\n").append(type_lines);
+    type_hashes.clear();
+    type_lines.clear();
+    rewind(spill);
+    return ftruncate(fileno(spill), 0) == 0;
+}
+
+bool StoreFormatter::finish() {
+    if (!flush()) {
+        return false;
+    }
+    current = UINT32_MAX;
+    return store.write_manifest(package, manifest);
+}
@@ -0,0 +1,135 @@
+//
+// Content-addressed store for formatted dump output, shared across games and runs.
+//
+// Layout under the store root:
+//   objects/<xx>/<hash>   formatted text of one image, named by the 128-bit hash of that text
+//   index/<hash>          hash of the object formatted from the image records with this hash
+//   manifests/<package>-<seconds>.<nanoseconds>-<pid>.txt
+//                         per-run manifest: the images and types of a dump and their hashes; only
+//                         the newest kStoreManifestsKept of each package are kept
+//
+// Identical images (mscorlib, UnityEngine.*) are stored once, and an image whose records did not
+// change since an earlier run is copied from its object instead of being formatted again. Records
+// are hashed in their portable form and objects are formatted without VAs, so neither depends on
+// where libil2cpp.so was loaded: the VAs are added back while dump.cs is assembled. Files are
+// written to a temporary name and renamed, so concurrent dumps can share a store.
+//
+
+#ifndef ZYGISK_IL2CPPDUMPER_DUMP_STORE_H
+#define ZYGISK_IL2CPPDUMPER_DUMP_STORE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <cstdio>
+#include <functional>
+#include <string>
+#include <vector>
+#include "dump_record.h"
+
+struct Hash128 {
+    uint64_t low;
+    uint64_t high;
+
+    std::string hex() const;
+};
+
+// MurmurHash3 x64 128, fed in pieces: the result only depends on the bytes, not on how they were
+// split between update calls.
+class Hasher128 {
+public:
+    void update(const void *data, size_t size);
+
+    Hash128 final() const;
+
+private:
+    void block(const uint8_t *data);
+
+    uint64_t h1 = 0;
+    uint64_t h2 = 0;
+    uint64_t length = 0;
+    uint8_t tail[16];
+    size_t tail_size = 0;
+};
+
+Hash128 hash128(const void *data, size_t size);
+
+// Manifests kept per package; older runs are deleted when a new one is written.
+static constexpr size_t kStoreManifestsKept = 8;
+
+class DumpStore {
+public:
+    explicit DumpStore(std::string root) : root(std::move(root)) {}
+
+    // Creates the store directories. Returns false if the store cannot be used.
+    bool open();
+
+    // Finds the object previously formatted from image records hashing to records.
+    bool lookup(const Hash128 &records, Hash128 *content);
+
+    FILE *open_object(const Hash128 &content);
+
+    // Where a new object is written before commit() moves it into place.
+    std::string temp_path(const char *name) const;
+
+    // Renames the object written at path to its hash unless an identical object exists, and
+    // indexes it by records.
+    bool commit(const Hash128 &records, const Hash128 &content, const std::string &path);
+
+    // Writes the manifest of this run and deletes the package's oldest ones beyond kStoreManifestsKept.
+    bool write_manifest(const std::string &package, const std::string &text);
+
+    uint32_t reused = 0;       // images copied from an existing object without formatting
+    uint32_t stored = 0;       // new objects written
+    uint32_t deduplicated = 0; // images formatted again whose object already existed
+
+private:
+    bool write_file(const std::string &path, const std::string &text);
+
+    std::string object_path(const Hash128 &content) const;
+
+    std::string root;
+};
+
+// Turns the TYPE records of a dump into dump.cs text one image at a time, going through the store.
+// Records must arrive grouped by image, which is how il2cpp_dump produces them. The records of the
+// current image wait in a spill file next to the store and the text is handed to output in chunks,
+// so memory use does not grow with the size of an image.
+class StoreFormatter {
+public:
+    // output receives dump.cs text in order; base is the load bias added to the RVAs.
+    StoreFormatter(DumpStore &store, const std::vector<std::string> &images, const std::string &package,
+                   uint64_t base, std::function<bool(const std::string &)> output);
+
+    ~StoreFormatter();
+
+    // Adds one type. When it starts a new image, the previous image is written to output.
+    bool add(const TypeRecord &type);
+
+    // Writes the last image and the manifest.
+    bool finish();
+
+private:
+    bool flush();
+
+    bool copy_object(FILE *object);
+
+    bool format_spilled(const std::string &image_name, const std::string &path, Hash128 *content, bool *complete);
+
+    bool emit(const std::string &text);
+
+    DumpStore &store;
+    const std::vector<std::string> &images;
+    std::string package;
+    uint64_t base;
+    std::function<bool(const std::string &)> output;
+    std::string manifest;
+    uint32_t current = UINT32_MAX;
+    FILE *spill = nullptr;
+    std::string record;
+    std::string type_hashes; // 16 bytes per type of the current image
+    std::string type_lines;  // its manifest lines
+    std::string chunk;
+    std::string with_va;
+};
+
+#endif //ZYGISK_IL2CPPDUMPER_DUMP_STORE_H
@@ -22,8 +22,13 @@
 // Created by Perfare on 2020/7/4.
 
 #include "hack.h"
+#include "config.h"
 #include "il2cpp_dump.h"
+#include "load_watcher.h"
 #include "log.h"
+#include "profiler.h"
+#include "stats.h"
+#include "thread_policy.h"
 #include "xdl.h"
 #include <cstring>
 #include <cstdio>
@@ -35,7 +40,9 @@
 #include <sys/mman.h>
 #include <linux/unistd.h> // Para __NR_memfd_create
 #include <sys/syscall.h>  // Para syscall
+#include <algorithm>
 #include <array>
+#include <chrono>
 #include <string>         // Para std::string
 #include <linux/limits.h> // Para PATH_MAX
 #include <cerrno>         // Para strerror
@@ -51,26 +58,40 @@ void hack_start(const char *game_data_dir) {
         LOGE("game_data_dir is null in hack_start. Aborting.");
         return;
     }
-
-    bool load = false;
-    for (int i = 0; i < 10; i++) {
-        void *handle = xdl_open("libil2cpp.so", 0);
-        if (handle) {
-            LOGI("libil2cpp.so loaded successfully at try %d. Handle: %p", i + 1, handle);
-            load = true;
-            il2cpp_api_init(handle); // il2cpp_api_init ya contiene la lógica de inicialización y obtención de la base.
-            il2cpp_dump(game_data_dir);
-            // xdl_close(handle); // Considerar si cerrar el handle aquí o dejarlo para el sistema.
-            // Si il2cpp_dump usa funciones de la librería después de la inicialización, no cerrar.
+    // Prioridad baja, núcleos pequeños y E/S en segundo plano: el volcado no debe quitarle frames al juego.
+    thread_policy_apply(config_get());
+
+    // Normalmente el load watcher avisa en cuanto libil2cpp.so se mapea; el sondeo queda como respaldo.
+    // Se espera en tramos de un segundo y se vuelve a probar xdl_open en cada uno: si el hook no salta,
+    // no se tarda más que sondeando.
+    void *handle = xdl_open("libil2cpp.so", 0);
+    for (int i = 0; !handle && i < 60 && load_watcher_installed(); i++) {
+        bool loaded = load_watcher_wait_loaded(1000);
+        handle = xdl_open("libil2cpp.so", 0);
+        if (loaded) {
             break;
-        } else {
-            LOGW("Failed to load libil2cpp.so at try %d. Waiting 1 second.", i + 1);
-            sleep(1);
         }
     }
-    if (!load) {
+    for (int i = 0; !handle && i < 10; i++) {
+        LOGW("Failed to load libil2cpp.so at try %d. Waiting 1 second.", i + 1);
+        sleep(1);
+        handle = xdl_open("libil2cpp.so", 0);
+    }
+    if (handle) {
+        LOGI("libil2cpp.so loaded successfully. Handle: %p", handle);
+        il2cpp_api_init(handle); // il2cpp_api_init ya contiene la lógica de inicialización y obtención de la base.
+        il2cpp_dump(game_data_dir);
+        // El profiler tarda profiler_seconds: las estadísticas del volcado se guardan antes.
+        if (config_get().profiler_hz > 0) {
+            stats_flush(game_data_dir);
+            profiler_run(game_data_dir, config_get());
+        }
+        // xdl_close(handle); // Considerar si cerrar el handle aquí o dejarlo para el sistema.
+        // Si il2cpp_dump usa funciones de la librería después de la inicialización, no cerrar.
+    } else {
         LOGE("libil2cpp.so not found after 10 tries in thread %d.", gettid());
     }
+    stats_flush(game_data_dir);
 }
 
 std::string GetLibDir(JavaVM *vms) {
@@ -175,6 +196,45 @@ struct NativeBridgeCallbacks {
     void *(*loadLibraryExt)(const char *libpath, int flag, void *ns);
 };
 
+static bool WriteFully(int fd, const void *data, size_t length) {
+    auto ptr = (const char *) data;
+    while (length > 0) {
+        auto written = write(fd, ptr, length);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        ptr += written;
+        length -= (size_t) written;
+    }
+    return true;
+}
+
+// Plazo total para que la app y el puente nativo estén listos.
+static constexpr long kNativeBridgeDeadlineMs = 15 * 1000;
+
+// Sondea ready() con backoff exponencial (10 ms, duplicando hasta 320 ms) hasta que devuelva true.
+// Devuelve los milisegundos esperados, o -1 si se agotó deadline_ms.
+template<typename F>
+static long WaitUntil(F &&ready, long deadline_ms) {
+    auto start = std::chrono::steady_clock::now();
+    auto delay = std::chrono::milliseconds(10);
+    while (true) {
+        auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+                std::chrono::steady_clock::now() - start).count();
+        if (ready()) {
+            return (long) elapsed;
+        }
+        if (elapsed >= deadline_ms) {
+            return -1;
+        }
+        std::this_thread::sleep_for(delay);
+        delay = std::min(delay * 2, std::chrono::milliseconds(320));
+    }
+}
+
 bool NativeBridgeLoad(const char *game_data_dir, int api_level, void *arm_so_data_param, size_t arm_so_length_param) {
     LOGI("NativeBridgeLoad called. game_data_dir: %s, api_level: %d", game_data_dir ? game_data_dir : "null", api_level);
 
@@ -185,10 +245,8 @@ bool NativeBridgeLoad(const char *game_data_dir, int api_level, void *arm_so_dat
         return false;
     }
 
-    // Esperar a que Houdini (o el puente nativo) se inicialice.
-    LOGI("Waiting 5 seconds for native bridge initialization...");
-    sleep(5);
-
+    // En lugar de un sleep(5) fijo, sondeamos condiciones baratas con backoff exponencial.
+    auto wait_start = std::chrono::steady_clock::now();
     auto libart_handle = dlopen("libart.so", RTLD_NOW);
     if (!libart_handle) {
         LOGE("Failed to dlopen libart.so: %s", dlerror());
@@ -206,36 +264,62 @@ bool NativeBridgeLoad(const char *game_data_dir, int api_level, void *arm_so_dat
     }
     LOGI("JNI_GetCreatedJavaVMs_ptr: %p", JNI_GetCreatedJavaVMs_ptr);
 
-    JavaVM *vms_buf[1];
+    // Listo cuando existe la JavaVM y la Application ya expone su nativeLibraryDir.
     JavaVM *vms = nullptr;
-    jsize num_vms;
-    jint status = JNI_GetCreatedJavaVMs_ptr(vms_buf, 1, &num_vms);
-    if (status == JNI_OK && num_vms > 0) {
-        vms = vms_buf[0];
-        LOGI("Successfully got JavaVM: %p", vms);
-    } else {
-        LOGE("Failed to get JavaVMs. Status: %d, num_vms: %d", status, num_vms);
-        munmap(arm_so_data_param, arm_so_length_param);
-        return false;
-    }
-
-    auto lib_dir = GetLibDir(vms);
-    if (lib_dir.empty()) {
-        LOGE("GetLibDir failed or returned empty path.");
+    std::string lib_dir;
+    auto app_wait_ms = WaitUntil([&] {
+        if (!vms) {
+            JavaVM *vms_buf[1];
+            jsize num_vms = 0;
+            if (JNI_GetCreatedJavaVMs_ptr(vms_buf, 1, &num_vms) != JNI_OK || num_vms <= 0) {
+                return false;
+            }
+            vms = vms_buf[0];
+            LOGI("Successfully got JavaVM: %p", vms);
+        }
+        lib_dir = GetLibDir(vms);
+        return !lib_dir.empty();
+    }, kNativeBridgeDeadlineMs);
+    if (app_wait_ms < 0) {
+        LOGE("JavaVM or nativeLibraryDir not available after %ld ms.", kNativeBridgeDeadlineMs);
+        stats_record("native_bridge_wait_ms", "timeout");
         munmap(arm_so_data_param, arm_so_length_param);
         return false;
     }
     // Si la librería nativa ya es x86 (o la arquitectura del host), no necesitamos el puente.
     if (lib_dir.find("/lib/x86") != std::string::npos || lib_dir.find("/lib/x86_64") != std::string::npos) {
         LOGI("Running on x86/x86_64 architecture, no need for NativeBridge for this library: %s", lib_dir.c_str());
+        stats_record("native_bridge_wait_ms", "%ld", app_wait_ms);
         munmap(arm_so_data_param, arm_so_length_param); // Liberar los datos del .so ARM, ya que no se usarán.
         return false; // Indica que el hack_start principal (x86) debe continuar.
     }
 
+    // Esperar (sin forzar la carga) a que ART haya cargado el puente y NativeBridgeItf sea resoluble.
+    auto native_bridge_lib_name = GetNativeBridgeLibrary();
+    auto bridge_name = native_bridge_lib_name.empty() || native_bridge_lib_name == "0" ? std::string("libhoudini.so")
+                                                                                       : native_bridge_lib_name;
+    auto remaining_ms = kNativeBridgeDeadlineMs - (long) std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now() - wait_start).count();
+    auto bridge_wait_ms = WaitUntil([&] {
+        auto bridge = xdl_open(bridge_name.c_str(), XDL_DEFAULT);
+        if (!bridge) {
+            return false;
+        }
+        auto itf = xdl_sym(bridge, "NativeBridgeItf", nullptr);
+        xdl_close(bridge);
+        return itf != nullptr;
+    }, remaining_ms > 0 ? remaining_ms : 0);
+    if (bridge_wait_ms < 0) {
+        LOGW("NativeBridgeItf of %s not resolvable yet, loading the bridge anyway.", bridge_name.c_str());
+    }
+    auto wait_ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now() - wait_start).count();
+    LOGI("Native bridge readiness wait: %lld ms", (long long) wait_ms);
+    stats_record("native_bridge_wait_ms", "%lld", (long long) wait_ms);
+
     LOGI("Attempting to load native bridge (e.g., libhoudini.so)...");
     void *nb_handle = dlopen("libhoudini.so", RTLD_NOW);
     if (!nb_handle) {
-        auto native_bridge_lib_name = GetNativeBridgeLibrary();
         if (native_bridge_lib_name.empty() || strcmp(native_bridge_lib_name.c_str(),"0") == 0) {
              LOGW("ro.dalvik.vm.native.bridge is not set or is '0'. No native bridge library specified.");
         } else {
@@ -264,27 +348,18 @@ bool NativeBridgeLoad(const char *game_data_dir, int api_level, void *arm_so_dat
                 return false;
             }
 
-            if (ftruncate(fd, (off_t) arm_so_length_param) == -1) {
-                 LOGE("ftruncate failed for memfd: %s", strerror(errno));
-                 close(fd);
-                 dlclose(nb_handle);
-                 munmap(arm_so_data_param, arm_so_length_param);
-                 return false;
-            }
-
-            void *mem = mmap(nullptr, arm_so_length_param, PROT_WRITE, MAP_SHARED, fd, 0);
-            if (mem == MAP_FAILED) {
-                LOGE("mmap failed for memfd: %s", strerror(errno));
+            // write() desde el mapeo de solo lectura es una copia normal, igual de cara que el memcpy de antes;
+            // lo que se ahorra es el ftruncate y el segundo mapeo MAP_SHARED escribible del memfd.
+            madvise(arm_so_data_param, arm_so_length_param, MADV_SEQUENTIAL);
+            bool written = WriteFully(fd, arm_so_data_param, arm_so_length_param);
+            munmap(arm_so_data_param, arm_so_length_param); // Liberar el mapeo original cuanto antes.
+            if (!written) {
+                LOGE("write failed for memfd: %s", strerror(errno));
                 close(fd);
                 dlclose(nb_handle);
-                munmap(arm_so_data_param, arm_so_length_param);
                 return false;
             }
 
-            memcpy(mem, arm_so_data_param, arm_so_length_param);
-            munmap(mem, arm_so_length_param); // Desenmapear la escritura, el kernel mantiene los datos.
-            munmap(arm_so_data_param, arm_so_length_param); // Liberar el buffer original.
-
             char path[PATH_MAX];
             snprintf(path, PATH_MAX, "/proc/self/fd/%d", fd);
             LOGI("ARM helper .so prepared at memfd path: %s", path);
@@ -314,8 +389,8 @@ bool NativeBridgeLoad(const char *game_data_dir, int api_level, void *arm_so_dat
                 if (init_arm_lib) {
                     LOGI("JNI_OnLoad trampoline obtained from ARM helper .so: %p", (void*)init_arm_lib);
                     // Llamar a JNI_OnLoad de la librería ARM.
-                    // El segundo argumento `reserved` se usa para pasar `game_data_dir`.
-                    jint onload_result = init_arm_lib(vms, (void *) game_data_dir);
+                    // El segundo argumento `reserved` se usa para pasar la configuración (incluye game_data_dir).
+                    jint onload_result = init_arm_lib(vms, (void *) &config_get());
                     LOGI("JNI_OnLoad for ARM helper .so returned: %d", onload_result);
                     if (onload_result == JNI_ERR) {
                         LOGE("JNI_OnLoad in ARM helper .so indicated an error.");
@@ -395,24 +470,27 @@ void hack_prepare(const char *game_data_dir_param, void *arm_so_data_param, size
     }
     hack_start(game_data_dir_param);
 #endif
+    stats_flush(game_data_dir_param);
     LOGI("hack_prepare finished for %s.", game_data_dir_param);
 }
 
 #if defined(__arm__) || defined(__aarch64__)
 // Este JNI_OnLoad es para la librería ARM auxiliar cuando se carga en un proceso x86 mediante NativeBridge.
 JNIEXPORT jint JNICALL JNI_OnLoad(JavaVM *vm, void *reserved) {
-    // 'reserved' se espera que sea const char* game_data_dir
-    const char *game_data_dir = (const char *) reserved;
-    LOGI("JNI_OnLoad (ARM helper library) called. Game data dir: %s", game_data_dir ? game_data_dir : "null");
+    // 'reserved' se espera que sea const DumperConfig* (mismo layout en x86 y ARM).
+    auto config = (const DumperConfig *) reserved;
+    LOGI("JNI_OnLoad (ARM helper library) called. Game data dir: %s", config ? config->game_data_dir : "null");
     
     if (!vm) {
         LOGE("JNI_OnLoad (ARM helper): JavaVM is null!");
         return JNI_ERR;
     }
-    if (!game_data_dir) {
-        LOGE("JNI_OnLoad (ARM helper): game_data_dir (reserved) is null!");
+    if (!config || !config->game_data_dir[0]) {
+        LOGE("JNI_OnLoad (ARM helper): config (reserved) is null!");
         return JNI_ERR;
     }
+    config_set(*config);
+    const char *game_data_dir = config_get().game_data_dir;
 
     // Iniciar el volcado en un nuevo hilo desde la librería ARM.
     std::thread hack_thread(hack_start, game_data_dir);
@@ -422,17 +500,3 @@ JNIEXPORT jint JNICALL JNI_OnLoad(JavaVM *vm, void *reserved) {
 }
 #endif
 
------ ARCHIVO: hack.h -----
-
-//
-// Created by Perfare on 2020/7/4.
-//
-
-#ifndef ZYGISK_IL2CPPDUMPER_HACK_H
-#define ZYGISK_IL2CPPDUMPER_HACK_H
-
-#include <stddef.h>
-
-void hack_prepare(const char *game_data_dir, void *data, size_t length);
-
-#endif //ZYGISK_IL2CPPDUMPER_HACK_H
\ No newline at end of file
@@ -4,18 +4,35 @@
 
 #include "il2cpp_dump.h"
 #include <dlfcn.h>
+#include <algorithm>
 #include <cstdlib>
 #include <cstring>
 #include <cinttypes>
+#include <chrono>
+#include <ctime>
 #include <string>
 #include <vector>
-#include <sstream>
-#include <fstream>
 #include <unistd.h>
 #include "xdl.h"
 #include "log.h"
+#include "config.h"
+#include "dump_filter.h"
+#include "dump_record.h"
+#include "dump_sink.h"
+#include "image_dump.h"
+#include "load_watcher.h"
+#include "memory_io.h"
+#include "metadata_scan.h"
+#include "method_index.h"
+#include "name_cache.h"
+#include "signature_scan.h"
+#include "stats.h"
+#include "symbolizer.h"
+#include "time_slice.h"
 #include "il2cpp-tabledefs.h"
 #include "il2cpp-class.h"
+#include "struct_layout.h"
+#include "version_detect.h"
 
 #define DO_API(r, n, p) r (*n) p
 
@@ -24,6 +41,9 @@
 #undef DO_API
 
 static uint64_t il2cpp_base = 0;
+// libil2cpp.so tal como está cargada, para el perf map y el archivo de símbolos.
+static CodeInfo il2cpp_code;
+static void *il2cpp_handle = nullptr;
 
 void init_il2cpp_api(void *handle) {
 #define DO_API(r, n, p) {                      \
@@ -38,292 +58,467 @@ void init_il2cpp_api(void *handle) {
 #undef DO_API
 }
 
-std::string get_method_modifier(uint32_t flags) {
-    std::stringstream outPut;
-    auto access = flags & METHOD_ATTRIBUTE_MEMBER_ACCESS_MASK;
-    switch (access) {
-        case METHOD_ATTRIBUTE_PRIVATE:
-            outPut << "private ";
-            break;
-        case METHOD_ATTRIBUTE_PUBLIC:
-            outPut << "public ";
-            break;
-        case METHOD_ATTRIBUTE_FAMILY:
-            outPut << "protected ";
-            break;
-        case METHOD_ATTRIBUTE_ASSEM:
-        case METHOD_ATTRIBUTE_FAM_AND_ASSEM:
-            outPut << "internal ";
-            break;
-        case METHOD_ATTRIBUTE_FAM_OR_ASSEM:
-            outPut << "protected internal ";
-            break;
-    }
-    if (flags & METHOD_ATTRIBUTE_STATIC) {
-        outPut << "static ";
+bool _il2cpp_type_is_byref(const Il2CppType *type) {
+    auto byref = type->byref;
+    if (il2cpp_type_is_byref) {
+        byref = il2cpp_type_is_byref(type);
     }
-    if (flags & METHOD_ATTRIBUTE_ABSTRACT) {
-        outPut << "abstract ";
-        if ((flags & METHOD_ATTRIBUTE_VTABLE_LAYOUT_MASK) == METHOD_ATTRIBUTE_REUSE_SLOT) {
-            outPut << "override ";
+    return byref;
+}
+
+static const char *str_or_empty(const char *str) {
+    return str ? str : "";
+}
+
+static NameCache type_names;
+
+// Nombre del tipo con sus argumentos genéricos ("List<Int32>" en vez de "List`1"). Cada tipo distinto
+// se formatea y se libera con il2cpp_free una sola vez.
+static const std::string &type_name(const Il2CppType *type) {
+    return type_names.get(type, [type]() {
+        std::string name;
+        if (config_get().generic_names && il2cpp_type_get_name && il2cpp_free) {
+            if (auto formatted = il2cpp_type_get_name(type)) {
+                name = formatted;
+                il2cpp_free(formatted);
+                // El "ref" ya lo escribe el formateador.
+                if (!name.empty() && name.back() == '&') {
+                    name.pop_back();
+                }
+                return name;
+            }
         }
-    } else if (flags & METHOD_ATTRIBUTE_FINAL) {
-        if ((flags & METHOD_ATTRIBUTE_VTABLE_LAYOUT_MASK) == METHOD_ATTRIBUTE_REUSE_SLOT) {
-            outPut << "sealed override ";
+        name = str_or_empty(il2cpp_class_get_name(il2cpp_class_from_type(type)));
+        return name;
+    });
+}
+
+static NameCache attribute_names;
+static std::vector<Il2CppClass *> field_attribute_classes;
+static int64_t attribute_ns = 0;
+static uint32_t attribute_count = 0;
+
+// Atributos de campo que se comprueban uno a uno: la API no tiene il2cpp_custom_attrs_from_field.
+static const char *const kFieldAttributes[][2] = {
+        {"UnityEngine", "SerializeField"},
+        {"UnityEngine", "SerializeReference"},
+        {"UnityEngine", "HideInInspector"},
+        {"System", "NonSerializedAttribute"},
+        {"System", "ThreadStaticAttribute"},
+        {"System", "ObsoleteAttribute"},
+        {"System.Runtime.CompilerServices", "CompilerGeneratedAttribute"},
+};
+
+static bool attributes_enabled() {
+    return config_get().attributes && il2cpp_custom_attrs_construct;
+}
+
+// Mide aparte lo que cuestan los atributos, que construyen objetos gestionados.
+struct AttributeTimer {
+    AttributeTimer() : start(std::chrono::steady_clock::now()) {}
+
+    ~AttributeTimer() {
+        attribute_ns += std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now() - start).count();
+    }
+
+    std::chrono::steady_clock::time_point start;
+};
+
+// Nombre del atributo como se escribe en C#, sin el sufijo "Attribute".
+static const std::string &attribute_name(Il2CppClass *klass) {
+    return attribute_names.get(klass, [klass]() {
+        std::string name = str_or_empty(il2cpp_class_get_name(klass));
+        static constexpr size_t suffix_length = sizeof("Attribute") - 1;
+        if (name.size() > suffix_length && name.compare(name.size() - suffix_length, suffix_length, "Attribute") == 0) {
+            name.resize(name.size() - suffix_length);
         }
-    } else if (flags & METHOD_ATTRIBUTE_VIRTUAL) {
-        if ((flags & METHOD_ATTRIBUTE_VTABLE_LAYOUT_MASK) == METHOD_ATTRIBUTE_NEW_SLOT) {
-            outPut << "virtual ";
-        } else {
-            outPut << "override ";
+        return name;
+    });
+}
+
+// Construye los atributos de info y libera info enseguida. Ejecuta sus constructores gestionados (por eso
+// attributes=0 por defecto): hasta Unity 2020 il2cpp los construye incluso para il2cpp_custom_attrs_has_attr,
+// así que no hay forma de leer solo los tipos.
+static void collect_attributes(Il2CppCustomAttrInfo *info, std::vector<std::string> *out) {
+    if (!info) {
+        return;
+    }
+    if (auto attrs = il2cpp_custom_attrs_construct(info)) {
+        auto items = (Il2CppObject **) attrs->vector;
+        for (il2cpp_array_size_t i = 0; i < attrs->max_length; ++i) {
+            if (items[i] && items[i]->klass) {
+                out->emplace_back(attribute_name(items[i]->klass));
+            }
         }
     }
-    if (flags & METHOD_ATTRIBUTE_PINVOKE_IMPL) {
-        outPut << "extern ";
+    if (il2cpp_custom_attrs_free) {
+        il2cpp_custom_attrs_free(info);
     }
-    return outPut.str();
+    attribute_count += out->size();
 }
 
-bool _il2cpp_type_is_byref(const Il2CppType *type) {
-    auto byref = type->byref;
-    if (il2cpp_type_is_byref) {
-        byref = il2cpp_type_is_byref(type);
+static void resolve_field_attributes(const Il2CppAssembly **assemblies, size_t size) {
+    field_attribute_classes.clear();
+    if (!il2cpp_field_has_attribute) {
+        return;
+    }
+    for (auto &entry: kFieldAttributes) {
+        for (size_t i = 0; i < size; ++i) {
+            auto image = il2cpp_assembly_get_image(assemblies[i]);
+            if (auto klass = il2cpp_class_from_name(image, entry[0], entry[1])) {
+                field_attribute_classes.push_back(klass);
+                break;
+            }
+        }
     }
-    return byref;
 }
 
-std::string dump_method(Il2CppClass *klass) {
-    std::stringstream outPut;
-    outPut << "\n\t// Methods\n";
+static StructLayout struct_layout = StructLayout::api;
+
+// Lectura de los miembros con un layout concreto, directamente de memoria.
+template<StructLayout L>
+struct MemberReader {
+    using Layout = Il2CppLayout<L>;
+
+    static const typename Layout::MethodInfo *method(const MethodInfo *m) {
+        return (const typename Layout::MethodInfo *) m;
+    }
+
+    static const typename Layout::FieldInfo *field(FieldInfo *f) {
+        return (const typename Layout::FieldInfo *) f;
+    }
+
+    static const char *method_name(const MethodInfo *m) { return method(m)->name; }
+
+    static uint32_t method_flags(const MethodInfo *m) { return method(m)->flags; }
+
+    static const Il2CppType *return_type(const MethodInfo *m) { return method(m)->return_type; }
+
+    static uint32_t param_count(const MethodInfo *m) { return method(m)->parameters_count; }
+
+    static const Il2CppType *param_type(const MethodInfo *m, uint32_t i) { return Layout::param_type(method(m), i); }
+
+    static const char *param_name(const MethodInfo *m, uint32_t i) {
+        auto name = Layout::param_name(method(m), i);
+        return name ? name : il2cpp_method_get_param_name(m, i);
+    }
+
+    static const char *field_name(FieldInfo *f) { return field(f)->name; }
+
+    static const Il2CppType *field_type(FieldInfo *f) { return field(f)->type; }
+
+    static uint32_t field_flags(FieldInfo *f) { return field(f)->type->attrs; }
+
+    static size_t field_offset(FieldInfo *f) { return (size_t) field(f)->offset; }
+};
+
+// Sin layout conocido: la API de siempre.
+template<>
+struct MemberReader<StructLayout::api> {
+    static const char *method_name(const MethodInfo *m) { return il2cpp_method_get_name(m); }
+
+    static uint32_t method_flags(const MethodInfo *m) {
+        uint32_t iflags = 0;
+        return il2cpp_method_get_flags(m, &iflags);
+    }
+
+    static const Il2CppType *return_type(const MethodInfo *m) { return il2cpp_method_get_return_type(m); }
+
+    static uint32_t param_count(const MethodInfo *m) { return il2cpp_method_get_param_count(m); }
+
+    static const Il2CppType *param_type(const MethodInfo *m, uint32_t i) { return il2cpp_method_get_param(m, i); }
+
+    static const char *param_name(const MethodInfo *m, uint32_t i) { return il2cpp_method_get_param_name(m, i); }
+
+    static const char *field_name(FieldInfo *f) { return il2cpp_field_get_name(f); }
+
+    static const Il2CppType *field_type(FieldInfo *f) { return il2cpp_field_get_type(f); }
+
+    static uint32_t field_flags(FieldInfo *f) { return il2cpp_field_get_flags(f); }
+
+    static size_t field_offset(FieldInfo *f) { return il2cpp_field_get_offset(f); }
+};
+
+template<StructLayout L>
+static void collect_methods(Il2CppClass *klass, TypeRecord *record) {
+    using R = MemberReader<L>;
     void *iter = nullptr;
     while (auto method = il2cpp_class_get_methods(klass, &iter)) {
-        //TODO attribute
+        auto &out = record->methods.emplace_back();
         if (method->methodPointer) {
-            outPut << "\t// RVA: 0x";
-            outPut << std::hex << (uint64_t) method->methodPointer - il2cpp_base;
-            outPut << " VA: 0x";
-            outPut << std::hex << (uint64_t) method->methodPointer;
-        } else {
-            outPut << "\t// RVA: 0x VA: 0x0";
-        }
-        /*if (method->slot != 65535) {
-            outPut << " Slot: " << std::dec << method->slot;
-        }*/
-        outPut << "\n\t";
-        uint32_t iflags = 0;
-        auto flags = il2cpp_method_get_flags(method, &iflags);
-        outPut << get_method_modifier(flags);
-        //TODO genericContainerIndex
-        auto return_type = il2cpp_method_get_return_type(method);
-        if (_il2cpp_type_is_byref(return_type)) {
-            outPut << "ref ";
-        }
-        auto return_class = il2cpp_class_from_type(return_type);
-        outPut << il2cpp_class_get_name(return_class) << " " << il2cpp_method_get_name(method)
-               << "(";
-        auto param_count = il2cpp_method_get_param_count(method);
-        for (int i = 0; i < param_count; ++i) {
-            auto param = il2cpp_method_get_param(method, i);
-            auto attrs = param->attrs;
-            if (_il2cpp_type_is_byref(param)) {
-                if (attrs & PARAM_ATTRIBUTE_OUT && !(attrs & PARAM_ATTRIBUTE_IN)) {
-                    outPut << "out ";
-                } else if (attrs & PARAM_ATTRIBUTE_IN && !(attrs & PARAM_ATTRIBUTE_OUT)) {
-                    outPut << "in ";
-                } else {
-                    outPut << "ref ";
-                }
-            } else {
-                if (attrs & PARAM_ATTRIBUTE_IN) {
-                    outPut << "[In] ";
-                }
-                if (attrs & PARAM_ATTRIBUTE_OUT) {
-                    outPut << "[Out] ";
-                }
-            }
-            auto parameter_class = il2cpp_class_from_type(param);
-            outPut << il2cpp_class_get_name(parameter_class) << " "
-                   << il2cpp_method_get_param_name(method, i);
-            outPut << ", ";
+            out.va = (uint64_t) method->methodPointer;
+            out.rva = out.va - il2cpp_base;
+        }
+        out.flags = R::method_flags(method);
+        auto return_type = R::return_type(method);
+        out.return_byref = _il2cpp_type_is_byref(return_type);
+        out.return_type = type_name(return_type);
+        out.name = str_or_empty(R::method_name(method));
+        if (attributes_enabled() && il2cpp_custom_attrs_from_method) {
+            AttributeTimer timer;
+            collect_attributes(il2cpp_custom_attrs_from_method(method), &out.attributes);
         }
-        if (param_count > 0) {
-            outPut.seekp(-2, outPut.cur);
+        auto param_count = R::param_count(method);
+        out.params.resize(param_count);
+        for (uint32_t i = 0; i < param_count; ++i) {
+            auto param = R::param_type(method, i);
+            auto &param_out = out.params[i];
+            param_out.attrs = param->attrs;
+            param_out.byref = _il2cpp_type_is_byref(param);
+            param_out.type_name = type_name(param);
+            param_out.name = str_or_empty(R::param_name(method, i));
         }
-        outPut << ") { }\n";
-        //TODO GenericInstMethod
     }
-    return outPut.str();
 }
 
-std::string dump_property(Il2CppClass *klass) {
-    std::stringstream outPut;
-    outPut << "\n\t// Properties\n";
+template<StructLayout L>
+static void collect_properties(Il2CppClass *klass, TypeRecord *record) {
+    using R = MemberReader<L>;
     void *iter = nullptr;
     while (auto prop_const = il2cpp_class_get_properties(klass, &iter)) {
-        //TODO attribute
         auto prop = const_cast<PropertyInfo *>(prop_const);
+        auto &out = record->properties.emplace_back();
         auto get = il2cpp_property_get_get_method(prop);
         auto set = il2cpp_property_get_set_method(prop);
-        auto prop_name = il2cpp_property_get_name(prop);
-        outPut << "\t";
-        Il2CppClass *prop_class = nullptr;
-        uint32_t iflags = 0;
+        out.name = str_or_empty(il2cpp_property_get_name(prop));
+        out.has_get = get != nullptr;
+        out.has_set = set != nullptr;
+        const Il2CppType *prop_type = nullptr;
         if (get) {
-            outPut << get_method_modifier(il2cpp_method_get_flags(get, &iflags));
-            prop_class = il2cpp_class_from_type(il2cpp_method_get_return_type(get));
+            out.accessor_flags = R::method_flags(get);
+            prop_type = R::return_type(get);
         } else if (set) {
-            outPut << get_method_modifier(il2cpp_method_get_flags(set, &iflags));
-            auto param = il2cpp_method_get_param(set, 0);
-            prop_class = il2cpp_class_from_type(param);
-        }
-        if (prop_class) {
-            outPut << il2cpp_class_get_name(prop_class) << " " << prop_name << " { ";
-            if (get) {
-                outPut << "get; ";
-            }
-            if (set) {
-                outPut << "set; ";
-            }
-            outPut << "}\n";
-        } else {
-            if (prop_name) {
-                outPut << " // unknown property " << prop_name;
-            }
+            out.accessor_flags = R::method_flags(set);
+            prop_type = R::param_count(set) ? R::param_type(set, 0) : nullptr;
+        }
+        out.known = prop_type && il2cpp_class_from_type(prop_type);
+        if (out.known) {
+            out.type_name = type_name(prop_type);
         }
     }
-    return outPut.str();
 }
 
-std::string dump_field(Il2CppClass *klass) {
-    std::stringstream outPut;
-    outPut << "\n\t// Fields\n";
+template<StructLayout L>
+static void collect_fields(Il2CppClass *klass, TypeRecord *record) {
+    using R = MemberReader<L>;
     auto is_enum = il2cpp_class_is_enum(klass);
     void *iter = nullptr;
     while (auto field = il2cpp_class_get_fields(klass, &iter)) {
-        //TODO attribute
-        outPut << "\t";
-        auto attrs = il2cpp_field_get_flags(field);
-        auto access = attrs & FIELD_ATTRIBUTE_FIELD_ACCESS_MASK;
-        switch (access) {
-            case FIELD_ATTRIBUTE_PRIVATE:
-                outPut << "private ";
-                break;
-            case FIELD_ATTRIBUTE_PUBLIC:
-                outPut << "public ";
-                break;
-            case FIELD_ATTRIBUTE_FAMILY:
-                outPut << "protected ";
-                break;
-            case FIELD_ATTRIBUTE_ASSEMBLY:
-            case FIELD_ATTRIBUTE_FAM_AND_ASSEM:
-                outPut << "internal ";
-                break;
-            case FIELD_ATTRIBUTE_FAM_OR_ASSEM:
-                outPut << "protected internal ";
-                break;
+        auto &out = record->fields.emplace_back();
+        out.flags = R::field_flags(field);
+        out.type_name = type_name(R::field_type(field));
+        out.name = str_or_empty(R::field_name(field));
+        //TODO 获取构造函数初始化后的字段值
+        if (out.flags & FIELD_ATTRIBUTE_LITERAL && is_enum) {
+            il2cpp_field_static_get_value(field, &out.value);
+            out.has_value = true;
         }
-        if (attrs & FIELD_ATTRIBUTE_LITERAL) {
-            outPut << "const ";
-        } else {
-            if (attrs & FIELD_ATTRIBUTE_STATIC) {
-                outPut << "static ";
-            }
-            if (attrs & FIELD_ATTRIBUTE_INIT_ONLY) {
-                outPut << "readonly ";
+        out.offset = R::field_offset(field);
+        if (attributes_enabled()) {
+            AttributeTimer timer;
+            for (auto attribute_class: field_attribute_classes) {
+                if (il2cpp_field_has_attribute(field, attribute_class)) {
+                    out.attributes.emplace_back(attribute_name(attribute_class));
+                }
             }
+            attribute_count += out.attributes.size();
         }
-        auto field_type = il2cpp_field_get_type(field);
-        auto field_class = il2cpp_class_from_type(field_type);
-        outPut << il2cpp_class_get_name(field_class) << " " << il2cpp_field_get_name(field);
-        //TODO 获取构造函数初始化后的字段值
-        if (attrs & FIELD_ATTRIBUTE_LITERAL && is_enum) {
-            uint64_t val = 0;
-            il2cpp_field_static_get_value(field, &val);
-            outPut << " = " << std::dec << val;
+    }
+}
+
+static void collect_events(Il2CppClass *klass, TypeRecord *record) {
+    void *iter = nullptr;
+    while (auto event = il2cpp_class_get_events(klass, &iter)) {
+        auto &out = record->events.emplace_back();
+        uint32_t iflags = 0;
+        if (auto accessor = event->add ? event->add : event->remove) {
+            out.accessor_flags = il2cpp_method_get_flags(accessor, &iflags);
         }
-        outPut << "; // 0x" << std::hex << il2cpp_field_get_offset(field) << "\n";
+        if (event->eventType) {
+            out.type_name = type_name(event->eventType);
+        }
+        out.name = str_or_empty(event->name);
     }
-    return outPut.str();
 }
 
-std::string dump_type(const Il2CppType *type) {
-    std::stringstream outPut;
+// Los tipos anidados también aparecen por sí mismos al recorrer la imagen: aquí sólo se enlazan
+// con su tipo contenedor, y cada uno se vuelca una única vez.
+static void collect_nesting(Il2CppClass *klass, TypeRecord *record) {
+    if (auto declaring = il2cpp_class_get_declaring_type(klass)) {
+        record->declaring_type = type_name(il2cpp_class_get_type(declaring));
+    }
+    void *iter = nullptr;
+    while (auto nested = il2cpp_class_get_nested_types(klass, &iter)) {
+        record->nested_types.emplace_back(str_or_empty(il2cpp_class_get_name(nested)));
+    }
+}
+
+template<StructLayout L>
+static void collect_type_as(const Il2CppType *type, uint32_t image_index, TypeRecord *record) {
     auto *klass = il2cpp_class_from_type(type);
-    outPut << "\n// Namespace: " << il2cpp_class_get_namespace(klass) << "\n";
-    auto flags = il2cpp_class_get_flags(klass);
-    if (flags & TYPE_ATTRIBUTE_SERIALIZABLE) {
-        outPut << "[Serializable]\n";
+    record->image_index = image_index;
+    record->namespaze = str_or_empty(il2cpp_class_get_namespace(klass));
+    record->name = str_or_empty(il2cpp_class_get_name(klass));
+    record->flags = il2cpp_class_get_flags(klass);
+    record->is_valuetype = il2cpp_class_is_valuetype(klass);
+    record->is_enum = il2cpp_class_is_enum(klass);
+    auto parent = il2cpp_class_get_parent(klass);
+    if (!record->is_valuetype && !record->is_enum && parent) {
+        auto parent_type = il2cpp_class_get_type(parent);
+        if (parent_type->type != IL2CPP_TYPE_OBJECT) {
+            record->extends.emplace_back(type_name(parent_type));
+        }
     }
-    //TODO attribute
-    auto is_valuetype = il2cpp_class_is_valuetype(klass);
-    auto is_enum = il2cpp_class_is_enum(klass);
-    auto visibility = flags & TYPE_ATTRIBUTE_VISIBILITY_MASK;
-    switch (visibility) {
-        case TYPE_ATTRIBUTE_PUBLIC:
-        case TYPE_ATTRIBUTE_NESTED_PUBLIC:
-            outPut << "public ";
-            break;
-        case TYPE_ATTRIBUTE_NOT_PUBLIC:
-        case TYPE_ATTRIBUTE_NESTED_FAM_AND_ASSEM:
-        case TYPE_ATTRIBUTE_NESTED_ASSEMBLY:
-            outPut << "internal ";
+    void *iter = nullptr;
+    while (auto itf = il2cpp_class_get_interfaces(klass, &iter)) {
+        record->extends.emplace_back(type_name(il2cpp_class_get_type(itf)));
+    }
+    if (attributes_enabled() && il2cpp_custom_attrs_from_class) {
+        AttributeTimer timer;
+        collect_attributes(il2cpp_custom_attrs_from_class(klass), &record->attributes);
+    }
+    collect_fields<L>(klass, record);
+    collect_properties<L>(klass, record);
+    collect_methods<L>(klass, record);
+    if (il2cpp_class_get_events) {
+        collect_events(klass, record);
+    }
+    if (il2cpp_class_get_declaring_type && il2cpp_class_get_nested_types) {
+        collect_nesting(klass, record);
+    }
+}
+
+// El layout se elige una vez por volcado; cada clase se lee con la especialización correspondiente.
+static void collect_type(const Il2CppType *type, uint32_t image_index, TypeRecord *record) {
+    switch (struct_layout) {
+        case StructLayout::v24_0:
+            collect_type_as<StructLayout::v24_0>(type, image_index, record);
             break;
-        case TYPE_ATTRIBUTE_NESTED_PRIVATE:
-            outPut << "private ";
+        case StructLayout::v24_1:
+            collect_type_as<StructLayout::v24_1>(type, image_index, record);
             break;
-        case TYPE_ATTRIBUTE_NESTED_FAMILY:
-            outPut << "protected ";
+        case StructLayout::v29:
+            collect_type_as<StructLayout::v29>(type, image_index, record);
             break;
-        case TYPE_ATTRIBUTE_NESTED_FAM_OR_ASSEM:
-            outPut << "protected internal ";
+        default:
+            collect_type_as<StructLayout::api>(type, image_index, record);
             break;
     }
-    if (flags & TYPE_ATTRIBUTE_ABSTRACT && flags & TYPE_ATTRIBUTE_SEALED) {
-        outPut << "static ";
-    } else if (!(flags & TYPE_ATTRIBUTE_INTERFACE) && flags & TYPE_ATTRIBUTE_ABSTRACT) {
-        outPut << "abstract ";
-    } else if (!is_valuetype && !is_enum && flags & TYPE_ATTRIBUTE_SEALED) {
-        outPut << "sealed ";
-    }
-    if (flags & TYPE_ATTRIBUTE_INTERFACE) {
-        outPut << "interface ";
-    } else if (is_enum) {
-        outPut << "enum ";
-    } else if (is_valuetype) {
-        outPut << "struct ";
-    } else {
-        outPut << "class ";
+}
+
+// Compara las lecturas directas con la API. Los punteros se comparan antes de seguir ninguno, así un
+// layout equivocado falla sin desreferenciar basura.
+template<StructLayout L>
+static bool layout_matches(const MethodInfo *method) {
+    using R = MemberReader<L>;
+    using A = MemberReader<StructLayout::api>;
+    auto param_count = A::param_count(method);
+    if (R::method_name(method) != A::method_name(method) || R::method_flags(method) != A::method_flags(method) ||
+        R::return_type(method) != A::return_type(method) || R::param_count(method) != param_count) {
+        return false;
     }
-    outPut << il2cpp_class_get_name(klass); //TODO genericContainerIndex
-    std::vector<std::string> extends;
-    auto parent = il2cpp_class_get_parent(klass);
-    if (!is_valuetype && !is_enum && parent) {
-        auto parent_type = il2cpp_class_get_type(parent);
-        if (parent_type->type != IL2CPP_TYPE_OBJECT) {
-            extends.emplace_back(il2cpp_class_get_name(parent));
+    for (uint32_t i = 0; i < param_count; ++i) {
+        if (R::param_type(method, i) != A::param_type(method, i)) {
+            return false;
         }
     }
-    void *iter = nullptr;
-    while (auto itf = il2cpp_class_get_interfaces(klass, &iter)) {
-        extends.emplace_back(il2cpp_class_get_name(itf));
+    for (uint32_t i = 0; i < param_count; ++i) {
+        if (strcmp(str_or_empty(R::param_name(method, i)), str_or_empty(A::param_name(method, i))) != 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+template<StructLayout L>
+static bool layout_matches(FieldInfo *field) {
+    using R = MemberReader<L>;
+    using A = MemberReader<StructLayout::api>;
+    return R::field_name(field) == A::field_name(field) && R::field_type(field) == A::field_type(field) &&
+           R::field_flags(field) == A::field_flags(field) && R::field_offset(field) == A::field_offset(field);
+}
+
+template<StructLayout L>
+static bool layout_matches_all(const std::vector<const MethodInfo *> &methods, const std::vector<FieldInfo *> &fields) {
+    for (auto method: methods) {
+        if (!layout_matches<L>(method)) {
+            return false;
+        }
+    }
+    for (auto field: fields) {
+        if (!layout_matches<L>(field)) {
+            return false;
+        }
     }
-    if (!extends.empty()) {
-        outPut << " : " << extends[0];
-        for (int i = 1; i < extends.size(); ++i) {
-            outPut << ", " << extends[i];
+    return true;
+}
+
+static constexpr size_t kLayoutSamples = 512;
+
+static bool layout_matches_all(StructLayout layout, const std::vector<const MethodInfo *> &methods,
+                               const std::vector<FieldInfo *> &fields) {
+    switch (layout) {
+        case StructLayout::v24_0:
+            return layout_matches_all<StructLayout::v24_0>(methods, fields);
+        case StructLayout::v24_1:
+            return layout_matches_all<StructLayout::v24_1>(methods, fields);
+        case StructLayout::v29:
+            return layout_matches_all<StructLayout::v29>(methods, fields);
+        default:
+            return false;
+    }
+}
+
+// Elige el layout de MethodInfo/FieldInfo comparando con la API sobre los primeros miembros del
+// dominio: primero el que indica la versión detectada y, sólo si no coincide, los demás. Si ninguno
+// coincide en todos, se sigue con la API.
+template<typename F>
+static void select_struct_layout(StructLayout expected, F &&for_each_class) {
+    struct_layout = StructLayout::api;
+    if (!config_get().direct_structs) {
+        return;
+    }
+    std::vector<const MethodInfo *> methods;
+    std::vector<FieldInfo *> fields;
+    for_each_class([&](Il2CppClass *klass) {
+        void *iter = nullptr;
+        while (auto method = il2cpp_class_get_methods(klass, &iter)) {
+            if (methods.size() < kLayoutSamples) {
+                methods.push_back(method);
+            }
+        }
+        iter = nullptr;
+        while (auto field = il2cpp_class_get_fields(klass, &iter)) {
+            if (fields.size() < kLayoutSamples) {
+                fields.push_back(field);
+            }
+        }
+        return methods.size() < kLayoutSamples || fields.size() < kLayoutSamples;
+    });
+    if (methods.empty() || fields.empty()) {
+        LOGW("no members to check struct layouts against");
+    } else if (layout_matches_all(expected, methods, fields)) {
+        struct_layout = expected;
+    } else {
+        if (expected != StructLayout::api) {
+            LOGW("struct layout %s expected for this version does not match", struct_layout_name(expected));
+        }
+        for (auto candidate: {StructLayout::v29, StructLayout::v24_1, StructLayout::v24_0}) {
+            if (candidate != expected && layout_matches_all(candidate, methods, fields)) {
+                struct_layout = candidate;
+                break;
+            }
         }
     }
-    outPut << "\n{";
-    outPut << dump_field(klass);
-    outPut << dump_property(klass);
-    outPut << dump_method(klass);
-    //TODO EventInfo
-    outPut << "}\n";
-    return outPut.str();
+    LOGI("struct layout: %s (%zu methods, %zu fields checked)", struct_layout_name(struct_layout), methods.size(),
+         fields.size());
+    stats_record("struct_layout", "%s", struct_layout_name(struct_layout));
 }
 
 void il2cpp_api_init(void *handle) {
     LOGI("il2cpp_handle: %p", handle);
+    il2cpp_handle = handle;
     init_il2cpp_api(handle);
     if (il2cpp_domain_get_assemblies) {
         Dl_info dlInfo;
@@ -331,10 +526,32 @@ void il2cpp_api_init(void *handle) {
             il2cpp_base = reinterpret_cast<uint64_t>(dlInfo.dli_fbase);
         }
         LOGI("il2cpp_base: %" PRIx64"", il2cpp_base);
+        il2cpp_code.machine = kElfMachine;
+        il2cpp_code.elf_class = kElfClass;
+        memory_find_module((uintptr_t) il2cpp_domain_get_assemblies, nullptr, [](const dl_phdr_info *info) {
+            il2cpp_code.base = info->dlpi_addr;
+            for (int i = 0; i < info->dlpi_phnum; ++i) {
+                auto &phdr = info->dlpi_phdr[i];
+                if (phdr.p_type == PT_LOAD && (phdr.p_flags & PF_X)) {
+                    auto start = info->dlpi_addr + phdr.p_vaddr;
+                    if (!il2cpp_code.code_start || start < il2cpp_code.code_start) {
+                        il2cpp_code.code_start = start;
+                    }
+                    il2cpp_code.code_end = std::max<uint64_t>(il2cpp_code.code_end, start + phdr.p_memsz);
+                }
+            }
+        });
     } else {
         LOGE("Failed to initialize il2cpp api.");
         return;
     }
+    // Tramos de un segundo: il2cpp_is_vm_thread se vuelve a comprobar aunque el hook de il2cpp_init no salte.
+    for (int i = 0; i < 30 && load_watcher_installed() && !il2cpp_is_vm_thread(nullptr); i++) {
+        if (load_watcher_wait_initialized(1000)) {
+            LOGI("il2cpp_init returned");
+            break;
+        }
+    }
     while (!il2cpp_is_vm_thread(nullptr)) {
         LOGI("Waiting for il2cpp_init...");
         sleep(1);
@@ -343,87 +560,358 @@ void il2cpp_api_init(void *handle) {
     il2cpp_thread_attach(domain);
 }
 
+typedef void *(*Assembly_Load_ftn)(void *, Il2CppString *, void *);
+typedef Il2CppArray *(*Assembly_GetTypes_ftn)(void *, void *);
+
+static const MethodInfo *assemblyLoad = nullptr;
+static const MethodInfo *assemblyGetTypes = nullptr;
+
+static bool init_reflection() {
+    auto corlib = il2cpp_get_corlib();
+    auto assemblyClass = il2cpp_class_from_name(corlib, "System.Reflection", "Assembly");
+    assemblyLoad = il2cpp_class_get_method_from_name(assemblyClass, "Load", 1);
+    assemblyGetTypes = il2cpp_class_get_method_from_name(assemblyClass, "GetTypes", 0);
+    if (assemblyLoad && assemblyLoad->methodPointer) {
+        LOGI("Assembly::Load: %p", assemblyLoad->methodPointer);
+    } else {
+        LOGI("miss Assembly::Load");
+        return false;
+    }
+    if (assemblyGetTypes && assemblyGetTypes->methodPointer) {
+        LOGI("Assembly::GetTypes: %p", assemblyGetTypes->methodPointer);
+    } else {
+        LOGI("miss Assembly::GetTypes");
+        return false;
+    }
+    return true;
+}
+
+// Nombre de klass independiente del resto del volcado: los tipos anidados no tienen namespace propio,
+// así que se usa el del tipo más externo y el nombre lleva la cadena de contenedores, "Outer/Inner".
+static void qualified_class_name(Il2CppClass *klass, std::string *namespaze, std::string *name) {
+    name->assign(str_or_empty(il2cpp_class_get_name(klass)));
+    while (il2cpp_class_get_declaring_type) {
+        auto declaring = il2cpp_class_get_declaring_type(klass);
+        if (!declaring) {
+            break;
+        }
+        name->insert(0, "/").insert(0, str_or_empty(il2cpp_class_get_name(declaring)));
+        klass = declaring;
+    }
+    namespaze->assign(str_or_empty(il2cpp_class_get_namespace(klass)));
+}
+
+// "Namespace.Outer/Inner", como las columnas namespace y name juntas.
+static std::string qualified_class_name(Il2CppClass *klass) {
+    std::string namespaze, name;
+    qualified_class_name(klass, &namespaze, &name);
+    return namespaze.empty() ? name : namespaze.append(".").append(name);
+}
+
+static void collect_skeleton(Il2CppClass *klass, uint32_t image_index, SkeletonRecord *record) {
+    record->image_index = image_index;
+    record->token = il2cpp_class_get_type_token(klass);
+    record->flags = il2cpp_class_get_flags(klass);
+    qualified_class_name(klass, &record->namespaze, &record->name);
+    if (auto parent = il2cpp_class_get_parent(klass)) {
+        record->parent = qualified_class_name(parent);
+    }
+    void *iter = nullptr;
+    while (auto itf = il2cpp_class_get_interfaces(klass, &iter)) {
+        record->interfaces.emplace_back(qualified_class_name(itf));
+    }
+}
+
+// Clases de cada imagen obtenidas por reflexión (antes de 2018.3). Todas las imágenes se cargan de una
+// vez, antes del volcado, y los arrays de Assembly.GetTypes() quedan fijados con un gchandle para
+// que el GC no los mueva ni los recoja mientras se vuelca. Las dos etapas y el reintento local
+// reutilizan el resultado sin volver a llamar a Assembly.Load.
+struct ReflectionTypes {
+    std::vector<std::vector<Il2CppClass *>> classes; // vacío para las imágenes filtradas
+    std::vector<uint32_t> handles;
+
+    ~ReflectionTypes() {
+        for (auto handle: handles) {
+            il2cpp_gchandle_free(handle);
+        }
+    }
+};
+
+static void load_reflection_types(const std::vector<std::string> &image_names, ReflectionTypes *types) {
+    auto start = std::chrono::steady_clock::now();
+    DumpFilter filter;
+    filter.compile(config_get().filters);
+    auto pin = il2cpp_gchandle_new && il2cpp_gchandle_free;
+    if (!pin) {
+        LOGW("il2cpp_gchandle_new not found, reflection arrays are not pinned");
+    }
+    types->classes.resize(image_names.size());
+    uint32_t loaded = 0;
+    for (size_t i = 0; i < image_names.size(); ++i) {
+        auto &imageName = image_names[i];
+        if (!filter.empty() && !filter.accept_image(imageName.c_str())) {
+            continue;
+        }
+        auto pos = imageName.rfind('.');
+        auto imageNameNoExt = imageName.substr(0, pos);
+        auto assemblyFileName = il2cpp_string_new(imageNameNoExt.data());
+        auto reflectionAssembly = ((Assembly_Load_ftn) assemblyLoad->methodPointer)(nullptr,
+                                                                                    assemblyFileName,
+                                                                                    nullptr);
+        if (!reflectionAssembly) {
+            continue;
+        }
+        auto reflectionTypes = ((Assembly_GetTypes_ftn) assemblyGetTypes->methodPointer)(
+                reflectionAssembly, nullptr);
+        if (!reflectionTypes) {
+            continue;
+        }
+        if (pin) {
+            types->handles.push_back(il2cpp_gchandle_new((Il2CppObject *) reflectionTypes, true));
+        }
+        auto items = reflectionTypes->vector;
+        auto &classes = types->classes[i];
+        classes.reserve(reflectionTypes->max_length);
+        for (il2cpp_array_size_t j = 0; j < reflectionTypes->max_length; ++j) {
+            classes.push_back(il2cpp_class_from_system_type((Il2CppReflectionType *) items[j]));
+        }
+        loaded++;
+    }
+    auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now() - start).count();
+    stats_record("reflection_images", "%u", loaded);
+    stats_record("reflection_load_ms", "%lld", (long long) elapsed);
+}
+
+// Visita cada clase de cada imagen en orden, con il2cpp_image_get_class o, antes de 2018.3, con las
+// clases ya cargadas por reflexión. visit(image_index, klass) devuelve false para abortar.
+// El filtro descarta imágenes enteras y clases sólo por su nombre, antes de leer ningún miembro.
+template<typename F>
+static bool visit_classes(const Il2CppAssembly **assemblies, size_t size, const std::vector<std::string> &image_names,
+                          const ReflectionTypes *reflection, DumpFilter &filter, TimeSlicer &slicer, F &&visit) {
+    auto accept_class = [&](Il2CppClass *klass) {
+        if (filter.empty()) {
+            return true;
+        }
+        // Los tipos anidados no tienen namespace propio: se filtran por el de su tipo más externo.
+        auto outer = klass;
+        while (il2cpp_class_get_declaring_type) {
+            auto declaring = il2cpp_class_get_declaring_type(outer);
+            if (!declaring) {
+                break;
+            }
+            outer = declaring;
+        }
+        return filter.accept_class(str_or_empty(il2cpp_class_get_namespace(outer)),
+                                   str_or_empty(il2cpp_class_get_name(klass)));
+    };
+    if (il2cpp_image_get_class) {
+        //使用il2cpp_image_get_class
+        DumpCursor cursor{0, 0};
+        const Il2CppImage *image = nullptr;
+        size_t classCount = 0;
+        while (cursor.image < size) {
+            if (cursor.klass == 0) {
+                if (!filter.empty() && !filter.accept_image(image_names[cursor.image].c_str())) {
+                    cursor.image++;
+                    continue;
+                }
+                image = il2cpp_assembly_get_image(assemblies[cursor.image]);
+                classCount = il2cpp_image_get_class_count(image);
+            }
+            if (cursor.klass >= classCount) {
+                cursor = {cursor.image + 1, 0};
+                continue;
+            }
+            auto klass = const_cast<Il2CppClass *>(il2cpp_image_get_class(image, cursor.klass));
+            if (accept_class(klass) && !visit(cursor.image, klass)) {
+                return false;
+            }
+            cursor.klass++;
+            // Entre dos clases, nunca con un lock de metadatos tomado.
+            slicer.tick(cursor);
+        }
+    } else {
+        //使用反射
+        for (uint32_t i = 0; i < size; ++i) {
+            if (!filter.empty() && !filter.accept_image(image_names[i].c_str())) {
+                continue;
+            }
+            auto &classes = reflection->classes[i];
+            for (uint32_t j = 0; j < classes.size(); ++j) {
+                if (accept_class(classes[j]) && !visit(i, classes[j])) {
+                    return false;
+                }
+                slicer.tick({i, j + 1});
+            }
+        }
+    }
+    return true;
+}
+
+static bool dump_to(DumpSink &sink, const Il2CppAssembly **assemblies, size_t size,
+                    const std::vector<std::string> &image_names, const ReflectionTypes *reflection,
+                    MethodIndex *index, uint32_t *type_count) {
+    if (!sink.begin(image_names, il2cpp_code)) {
+        return false;
+    }
+    *type_count = 0;
+    if (index) {
+        index->clear();
+    }
+    auto &config = config_get();
+    TimeSlicer slicer(config.slice_budget_us, config.slice_pause_us);
+    DumpFilter filter;
+    filter.compile(config.filters);
+    if (config.staged) {
+        // Etapa 1: sólo el índice de tipos, utilizable en cuanto se cierra y sin esperar a los miembros.
+        auto skeleton_start = std::chrono::steady_clock::now();
+        uint32_t skeleton_count = 0;
+        auto ok = visit_classes(assemblies, size, image_names, reflection, filter, slicer, [&](uint32_t image_index, Il2CppClass *klass) {
+            SkeletonRecord record{};
+            collect_skeleton(klass, image_index, &record);
+            skeleton_count++;
+            return sink.write_skeleton(record);
+        });
+        if (!ok || !sink.finish_skeleton()) {
+            return false;
+        }
+        auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+                std::chrono::steady_clock::now() - skeleton_start).count();
+        stats_record("skeleton_types", "%u", skeleton_count);
+        stats_record("skeleton_ms", "%lld", (long long) elapsed);
+        filter.reset_counters();
+    }
+    auto ok = visit_classes(assemblies, size, image_names, reflection, filter, slicer, [&](uint32_t image_index, Il2CppClass *klass) {
+        auto type = il2cpp_class_get_type(klass);
+        //LOGD("type name : %s", il2cpp_type_get_name(type));
+        TypeRecord record{};
+        collect_type(type, image_index, &record);
+        ++*type_count;
+        if (index) {
+            index->add_type(record);
+        }
+        return sink.write_type(record);
+    });
+    if (!ok || !sink.finish()) {
+        return false;
+    }
+    slicer.finish(*type_count);
+    filter.record_stats();
+    return true;
+}
+
 void il2cpp_dump(const char *outDir) {
     LOGI("dumping...");
+    auto start = std::chrono::steady_clock::now();
+    timespec cpu_start{};
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &cpu_start);
     size_t size;
     auto domain = il2cpp_domain_get();
     auto assemblies = il2cpp_domain_get_assemblies(domain, &size);
-    std::stringstream imageOutput;
+    std::vector<std::string> image_names;
     for (int i = 0; i < size; ++i) {
         auto image = il2cpp_assembly_get_image(assemblies[i]);
-        imageOutput << "// Image " << i << ": " << il2cpp_image_get_name(image) << "\n";
+        image_names.emplace_back(str_or_empty(il2cpp_image_get_name(image)));
     }
-    std::vector<std::string> outPuts;
+    ReflectionTypes reflection;
     if (il2cpp_image_get_class) {
         LOGI("Version greater than 2018.3");
-        //使用il2cpp_image_get_class
-        for (int i = 0; i < size; ++i) {
-            auto image = il2cpp_assembly_get_image(assemblies[i]);
-            std::stringstream imageStr;
-            imageStr << "\n// Dll : " << il2cpp_image_get_name(image);
-            auto classCount = il2cpp_image_get_class_count(image);
-            for (int j = 0; j < classCount; ++j) {
-                auto klass = il2cpp_image_get_class(image, j);
-                auto type = il2cpp_class_get_type(const_cast<Il2CppClass *>(klass));
-                //LOGD("type name : %s", il2cpp_type_get_name(type));
-                auto outPut = imageStr.str() + dump_type(type);
-                outPuts.push_back(outPut);
-            }
-        }
     } else {
         LOGI("Version less than 2018.3");
-        //使用反射
-        auto corlib = il2cpp_get_corlib();
-        auto assemblyClass = il2cpp_class_from_name(corlib, "System.Reflection", "Assembly");
-        auto assemblyLoad = il2cpp_class_get_method_from_name(assemblyClass, "Load", 1);
-        auto assemblyGetTypes = il2cpp_class_get_method_from_name(assemblyClass, "GetTypes", 0);
-        if (assemblyLoad && assemblyLoad->methodPointer) {
-            LOGI("Assembly::Load: %p", assemblyLoad->methodPointer);
-        } else {
-            LOGI("miss Assembly::Load");
+        if (!init_reflection()) {
             return;
         }
-        if (assemblyGetTypes && assemblyGetTypes->methodPointer) {
-            LOGI("Assembly::GetTypes: %p", assemblyGetTypes->methodPointer);
-        } else {
-            LOGI("miss Assembly::GetTypes");
+        load_reflection_types(image_names, &reflection);
+    }
+    auto &version = il2cpp_version_detect(il2cpp_handle, (const void *) il2cpp_domain_get_assemblies, outDir);
+    il2cpp_code.build_id = version.build_id;
+    select_struct_layout(version.layout, [&](auto &&visit) {
+        for (size_t i = 0; i < size; ++i) {
+            if (il2cpp_image_get_class) {
+                auto image = il2cpp_assembly_get_image(assemblies[i]);
+                auto classCount = il2cpp_image_get_class_count(image);
+                for (size_t j = 0; j < classCount; ++j) {
+                    if (!visit(const_cast<Il2CppClass *>(il2cpp_image_get_class(image, j)))) {
+                        return;
+                    }
+                }
+            } else {
+                for (auto klass: reflection.classes[i]) {
+                    if (!visit(klass)) {
+                        return;
+                    }
+                }
+            }
+        }
+    });
+    if (attributes_enabled()) {
+        resolve_field_attributes(assemblies, size);
+    }
+    uint32_t type_count = 0;
+    // Un único índice para los ficheros del índice, el simbolizador y los símbolos que escribe el sink.
+    std::unique_ptr<MethodIndex> index;
+    auto index_for = [&](const DumpSink &sink) {
+        if (!index && (config_get().method_index || config_get().symbolizer || sink.wants_method_index())) {
+            index = std::make_unique<MethodIndex>();
+        }
+        return index.get();
+    };
+    // Con el companion, el formateo, la compresión y la escritura salen del proceso del juego.
+    auto sink = dump_sink_companion(config_get());
+    if (sink && !dump_to(*sink, assemblies, size, image_names, &reflection, index_for(*sink), &type_count)) {
+        LOGW("companion dump failed, writing dump.cs locally");
+        sink.reset();
+    }
+    if (!sink) {
+        sink = dump_sink_local(outDir, config_get());
+        if (!dump_to(*sink, assemblies, size, image_names, &reflection, index_for(*sink), &type_count)) {
+            LOGE("Failed to write dump file");
             return;
         }
-        typedef void *(*Assembly_Load_ftn)(void *, Il2CppString *, void *);
-        typedef Il2CppArray *(*Assembly_GetTypes_ftn)(void *, void *);
-        for (int i = 0; i < size; ++i) {
-            auto image = il2cpp_assembly_get_image(assemblies[i]);
-            std::stringstream imageStr;
-            auto image_name = il2cpp_image_get_name(image);
-            imageStr << "\n// Dll : " << image_name;
-            //LOGD("image name : %s", image->name);
-            auto imageName = std::string(image_name);
-            auto pos = imageName.rfind('.');
-            auto imageNameNoExt = imageName.substr(0, pos);
-            auto assemblyFileName = il2cpp_string_new(imageNameNoExt.data());
-            auto reflectionAssembly = ((Assembly_Load_ftn) assemblyLoad->methodPointer)(nullptr,
-                                                                                        assemblyFileName,
-                                                                                        nullptr);
-            auto reflectionTypes = ((Assembly_GetTypes_ftn) assemblyGetTypes->methodPointer)(
-                    reflectionAssembly, nullptr);
-            auto items = reflectionTypes->vector;
-            for (int j = 0; j < reflectionTypes->max_length; ++j) {
-                auto klass = il2cpp_class_from_system_type((Il2CppReflectionType *) items[j]);
-                auto type = il2cpp_class_get_type(klass);
-                //LOGD("type name : %s", il2cpp_type_get_name(type));
-                auto outPut = imageStr.str() + dump_type(type);
-                outPuts.push_back(outPut);
-            }
+    }
+    auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now() - start).count();
+    stats_record("dump_sink", "%s", sink->name());
+    stats_record("dump_types", "%u", type_count);
+    type_names.record_stats("type_name_cache");
+    if (attributes_enabled()) {
+        stats_record("attributes", "%u", attribute_count);
+        stats_record("attributes_ms", "%lld", (long long) (attribute_ns / 1000000));
+        attribute_names.record_stats("attribute_name_cache");
+    }
+    timespec cpu_end{};
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &cpu_end);
+    stats_record("dump_ms", "%lld", (long long) elapsed);
+    stats_record("dump_cpu_ms", "%lld", (long long) (cpu_end.tv_sec - cpu_start.tv_sec) * 1000 +
+                                        (cpu_end.tv_nsec - cpu_start.tv_nsec) / 1000000);
+    // El índice se escribe siempre en el directorio del juego: lo usa el propio proceso, no el companion.
+    if (index) {
+        index->build(il2cpp_code);
+        if (sink->wants_method_index()) {
+            sink->write_symbols(*index);
+        }
+        auto base = std::string(outDir).append("/files/method_index");
+        if (config_get().method_index && index->write_binary(base + ".bin") &&
+            index->write_csv(base + ".csv", image_names)) {
+            LOGI("method index: %zu methods -> %s.bin", index->entries().size(), base.c_str());
+        }
+        index->record_stats();
+        // La tabla del simbolizador vive hasta que muere el proceso: los handlers de crash la consultan.
+        if (config_get().symbolizer) {
+            symbolizer_install(*index, il2cpp_code, image_names);
         }
     }
-    LOGI("write dump file");
-    auto outPath = std::string(outDir).append("/files/dump.cs");
-    std::ofstream outStream(outPath);
-    outStream << imageOutput.str();
-    auto count = outPuts.size();
-    for (int i = 0; i < count; ++i) {
-        outStream << outPuts[i];
+    // Después de il2cpp_init los juegos cifrados ya tienen la metadata descifrada en memoria.
+    if (config_get().metadata_dump) {
+        metadata_dump(outDir);
+    }
+    // Igual para el código: los packers descifran libil2cpp.so al cargarla.
+    if (config_get().image_dump) {
+        image_dump((const void *) il2cpp_domain_get_assemblies, outDir);
+    }
+    if (config_get().signatures[0]) {
+        signature_dump((const void *) il2cpp_domain_get_assemblies, config_get().signatures, outDir);
     }
-    outStream.close();
     LOGI("dump done!");
-}
\ No newline at end of file
+}
@@ -0,0 +1,182 @@
+//
+// Writes the in-memory image of libil2cpp.so with its ELF headers fixed up.
+//
+
+#include "image_dump.h"
+#include <fcntl.h>
+#include <link.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cinttypes>
+#include <cstring>
+#include <string>
+#include <vector>
+#include "log.h"
+#include "memory_io.h"
+#include "stats.h"
+
+static constexpr size_t kImageChunk = 1024 * 1024;
+
+struct LoadedModule {
+    uintptr_t bias = 0;
+    ElfW(Addr) phdr_vaddr = 0;
+    std::vector<ElfW(Phdr)> phdrs;
+};
+
+static ElfW(Shdr) section(uint32_t name, uint32_t type, ElfW(Xword) flags, ElfW(Addr) address, ElfW(Xword) size,
+                          ElfW(Xword) align, ElfW(Xword) entsize) {
+    ElfW(Shdr) shdr{};
+    shdr.sh_name = name;
+    shdr.sh_type = type;
+    shdr.sh_flags = flags;
+    shdr.sh_addr = address;
+    shdr.sh_offset = address;
+    shdr.sh_size = size;
+    shdr.sh_addralign = align;
+    shdr.sh_entsize = entsize;
+    return shdr;
+}
+
+// Program headers point at the copied segments, section headers and their names go at the end.
+static bool fix_headers(int fd, const LoadedModule &module, ElfW(Addr) image_size) {
+    ElfW(Ehdr) ehdr;
+    if (pread(fd, &ehdr, sizeof(ehdr), 0) != sizeof(ehdr) || memcmp(ehdr.e_ident, ELFMAG, SELFMAG) != 0) {
+        // Some packers wipe the header once loaded: rebuild it from what the linker reports.
+        LOGW("image: no ELF header in memory, rebuilding it");
+        ehdr = {};
+        memcpy(ehdr.e_ident, ELFMAG, SELFMAG);
+        ehdr.e_ident[EI_CLASS] = kElfClass;
+        ehdr.e_ident[EI_DATA] = ELFDATA2LSB;
+        ehdr.e_ident[EI_VERSION] = EV_CURRENT;
+        ehdr.e_type = ET_DYN;
+        ehdr.e_machine = kElfMachine;
+        ehdr.e_version = EV_CURRENT;
+        ehdr.e_ehsize = sizeof(ElfW(Ehdr));
+        ehdr.e_phoff = module.phdr_vaddr;
+        ehdr.e_phentsize = sizeof(ElfW(Phdr));
+        ehdr.e_phnum = (ElfW(Half)) module.phdrs.size();
+    }
+    std::vector<ElfW(Phdr)> phdrs = module.phdrs;
+    auto phdrs_size = (ssize_t) (phdrs.size() * sizeof(ElfW(Phdr)));
+    if (ehdr.e_phentsize != sizeof(ElfW(Phdr)) || ehdr.e_phnum != phdrs.size()) {
+        LOGW("image: ELF header does not match the loaded program headers");
+        return false;
+    }
+    for (auto &phdr: phdrs) {
+        phdr.p_offset = phdr.p_vaddr;
+        phdr.p_filesz = phdr.p_memsz;
+    }
+
+    auto dynamic = memory_read_dynamic(module.bias, module.phdrs.data(), module.phdrs.size());
+    std::string names(1, '\0');
+    std::vector<ElfW(Shdr)> shdrs(1);
+    auto add_name = [&](const char *name) {
+        auto offset = (uint32_t) names.size();
+        names.append(name).push_back('\0');
+        return offset;
+    };
+    uint32_t dynstr_index = 0;
+    if (dynamic.strtab && dynamic.strsz) {
+        dynstr_index = (uint32_t) shdrs.size();
+        shdrs.push_back(section(add_name(".dynstr"), SHT_STRTAB, SHF_ALLOC, dynamic.strtab, dynamic.strsz, 1, 0));
+    }
+    if (dynamic.symtab && dynamic.symbols) {
+        auto &shdr = shdrs.emplace_back(section(add_name(".dynsym"), SHT_DYNSYM, SHF_ALLOC, dynamic.symtab,
+                                                dynamic.symbols * sizeof(ElfW(Sym)), sizeof(ElfW(Addr)),
+                                                sizeof(ElfW(Sym))));
+        shdr.sh_link = dynstr_index;
+        shdr.sh_info = 1;
+    }
+    if (dynamic.dynamic) {
+        auto &shdr = shdrs.emplace_back(section(add_name(".dynamic"), SHT_DYNAMIC, SHF_ALLOC | SHF_WRITE,
+                                                dynamic.dynamic, dynamic.dynamic_size, sizeof(ElfW(Addr)),
+                                                sizeof(ElfW(Dyn))));
+        shdr.sh_link = dynstr_index;
+    }
+    auto shstrtab_name = add_name(".shstrtab");
+    auto &shstrtab = shdrs.emplace_back(section(shstrtab_name, SHT_STRTAB, 0, 0, names.size(), 1, 0));
+    shstrtab.sh_offset = image_size;
+
+    auto shoff = (image_size + names.size() + sizeof(ElfW(Addr)) - 1) & ~(ElfW(Addr)) (sizeof(ElfW(Addr)) - 1);
+    ehdr.e_shoff = shoff;
+    ehdr.e_shentsize = sizeof(ElfW(Shdr));
+    ehdr.e_shnum = (ElfW(Half)) shdrs.size();
+    ehdr.e_shstrndx = (ElfW(Half)) (shdrs.size() - 1);
+    auto shdrs_size = (ssize_t) (shdrs.size() * sizeof(ElfW(Shdr)));
+    return pwrite(fd, phdrs.data(), phdrs_size, ehdr.e_phoff) == phdrs_size &&
+           pwrite(fd, names.data(), names.size(), image_size) == (ssize_t) names.size() &&
+           pwrite(fd, shdrs.data(), shdrs_size, shoff) == shdrs_size &&
+           pwrite(fd, &ehdr, sizeof(ehdr), 0) == sizeof(ehdr);
+}
+
+bool image_dump(const void *address, const char *game_data_dir) {
+    auto start = std::chrono::steady_clock::now();
+    LoadedModule module;
+    memory_find_module((uintptr_t) address, nullptr, [&](const dl_phdr_info *info) {
+        module.bias = info->dlpi_addr;
+        module.phdr_vaddr = (uintptr_t) info->dlpi_phdr - info->dlpi_addr;
+        module.phdrs.assign(info->dlpi_phdr, info->dlpi_phdr + info->dlpi_phnum);
+    });
+    auto page_size = (ElfW(Addr)) getpagesize();
+    ElfW(Addr) image_size = 0;
+    for (auto &phdr: module.phdrs) {
+        if (phdr.p_type == PT_LOAD) {
+            image_size = std::max(image_size, (phdr.p_vaddr + phdr.p_memsz + page_size - 1) & ~(page_size - 1));
+        }
+    }
+    if (!image_size) {
+        LOGE("image: libil2cpp.so not found among the loaded modules");
+        return false;
+    }
+
+    char name[64];
+    snprintf(name, sizeof(name), "/files/libil2cpp_%" PRIxPTR ".so", module.bias);
+    auto path = std::string(game_data_dir).append(name);
+    auto tmp_path = path + ".tmp";
+    int fd = open(tmp_path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd == -1) {
+        LOGE("Unable to open %s: %s", tmp_path.c_str(), strerror(errno));
+        return false;
+    }
+    // Holes between segments and unreadable pages stay as zeros.
+    auto ok = ftruncate(fd, (off_t) image_size) == 0;
+    std::vector<uint8_t> buffer(kImageChunk);
+    uint64_t copied = 0;
+    uint32_t unreadable_pages = 0;
+    for (auto &phdr: module.phdrs) {
+        if (!ok || phdr.p_type != PT_LOAD) {
+            continue;
+        }
+        auto vaddr = phdr.p_vaddr & ~(page_size - 1);
+        auto end = (phdr.p_vaddr + phdr.p_memsz + page_size - 1) & ~(page_size - 1);
+        while (ok && vaddr < end) {
+            auto chunk = (size_t) std::min<ElfW(Addr)>(buffer.size(), end - vaddr);
+            auto n = memory_read(module.bias + vaddr, buffer.data(), chunk);
+            ok = n == 0 || pwrite(fd, buffer.data(), n, (off_t) vaddr) == (ssize_t) n;
+            copied += n;
+            if (n < chunk) {
+                // The page at vaddr + n faulted: leave it zeroed and go on after it.
+                unreadable_pages++;
+                n += page_size;
+            }
+            vaddr += n;
+        }
+    }
+    ok = ok && fix_headers(fd, module, image_size);
+    ok = close(fd) == 0 && ok;
+    if (!ok || rename(tmp_path.c_str(), path.c_str()) != 0) {
+        LOGE("Unable to write %s: %s", path.c_str(), strerror(errno));
+        unlink(tmp_path.c_str());
+        return false;
+    }
+    auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now() - start).count();
+    LOGI("libil2cpp.so image written to %s, load it at base 0x%" PRIxPTR, path.c_str(), module.bias);
+    stats_record("image_dump_base", "0x%" PRIxPTR, module.bias);
+    stats_record("image_dump_bytes", "%llu", (unsigned long long) copied);
+    stats_record("image_dump_unreadable_pages", "%u", unreadable_pages);
+    stats_record("image_dump_ms", "%lld", (long long) elapsed);
+    return true;
+}
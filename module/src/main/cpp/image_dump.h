@@ -0,0 +1,17 @@
+//
+// Writes the in-memory image of libil2cpp.so to <game_data_dir>/files/libil2cpp_<base>.so, for
+// games whose file on disk is packed or encrypted.
+//
+// Segments are copied at their virtual addresses (file offset == vaddr), so the program headers
+// only need their offsets and file sizes rewritten. Section headers for .dynsym, .dynstr and
+// .dynamic are rebuilt from the dynamic table. Relocations are already applied in memory: load the
+// file at the base address in its name.
+//
+
+#ifndef ZYGISK_IL2CPPDUMPER_IMAGE_DUMP_H
+#define ZYGISK_IL2CPPDUMPER_IMAGE_DUMP_H
+
+// address is any address inside libil2cpp.so.
+bool image_dump(const void *address, const char *game_data_dir);
+
+#endif //ZYGISK_IL2CPPDUMPER_IMAGE_DUMP_H
@@ -0,0 +1,309 @@
+//
+// Notifies the dumper as soon as libil2cpp.so is mapped and il2cpp_init has returned.
+//
+// Every loaded library gets its dlopen/android_dlopen_ext/dlsym GOT slots redirected to the hooks
+// below. The hooks forward to the linker's __loader_* entry points with the original caller
+// address, so namespaces are resolved exactly as if the library had called libdl itself. Whenever
+// a load succeeds, the libraries that appeared since the last walk are hooked as well, so the
+// chain libnativeloader -> libmain -> libunity -> libil2cpp is followed all the way down. Unity
+// resolves the il2cpp API with dlsym, which lets us wrap il2cpp_init and learn when it returns.
+//
+
+#include "load_watcher.h"
+#include <android/dlext.h>
+#include <dlfcn.h>
+#include <elf.h>
+#include <link.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include "xdl.h"
+#include "log.h"
+
+#if defined(__LP64__)
+#define LINKER_BASENAME "linker64"
+typedef ElfW(Rela) ElfReloc;
+#define DT_RELOC   DT_RELA
+#define DT_RELOCSZ DT_RELASZ
+#define RELOC_SYM(info)  ELF64_R_SYM(info)
+#define RELOC_TYPE(info) ELF64_R_TYPE(info)
+#else
+#define LINKER_BASENAME "linker"
+typedef ElfW(Rel) ElfReloc;
+#define DT_RELOC   DT_REL
+#define DT_RELOCSZ DT_RELSZ
+#define RELOC_SYM(info)  ELF32_R_SYM(info)
+#define RELOC_TYPE(info) ELF32_R_TYPE(info)
+#endif
+
+#if defined(__aarch64__)
+#define RELOC_JUMP_SLOT R_AARCH64_JUMP_SLOT
+#define RELOC_GLOB_DAT  R_AARCH64_GLOB_DAT
+#elif defined(__arm__)
+#define RELOC_JUMP_SLOT R_ARM_JUMP_SLOT
+#define RELOC_GLOB_DAT  R_ARM_GLOB_DAT
+#elif defined(__x86_64__)
+#define RELOC_JUMP_SLOT R_X86_64_JUMP_SLOT
+#define RELOC_GLOB_DAT  R_X86_64_GLOB_DAT
+#elif defined(__i386__)
+#define RELOC_JUMP_SLOT R_386_JMP_SLOT
+#define RELOC_GLOB_DAT  R_386_GLOB_DAT
+#endif
+
+static std::mutex watcher_mutex;
+static std::condition_variable watcher_cond;
+static bool watcher_installed = false;
+static bool il2cpp_loaded = false;
+static bool il2cpp_initialized = false;
+
+static void *(*loader_dlopen)(const char *, int, const void *) = nullptr;
+static void *(*loader_android_dlopen_ext)(const char *, int, const android_dlextinfo *, const void *) = nullptr;
+static void *(*loader_dlsym)(void *, const char *, const void *) = nullptr;
+static int (*orig_il2cpp_init)(const char *) = nullptr;
+
+// load bias -> pathname of every library whose imports were already hooked
+static std::mutex patch_mutex;
+static std::unordered_map<uintptr_t, std::string> patched_libs;
+
+static void signal_flag(bool &flag) {
+    {
+        std::lock_guard<std::mutex> lock(watcher_mutex);
+        flag = true;
+    }
+    watcher_cond.notify_all();
+}
+
+static bool wait_flag(const bool &flag, int timeout_ms) {
+    std::unique_lock<std::mutex> lock(watcher_mutex);
+    if (!watcher_installed) {
+        return false;
+    }
+    return watcher_cond.wait_for(lock, std::chrono::milliseconds(timeout_ms), [&] { return flag; });
+}
+
+static void hook_new_libraries();
+
+static int hooked_il2cpp_init(const char *domain_name) {
+    auto result = orig_il2cpp_init(domain_name);
+    LOGI("il2cpp_init(%s) returned %d", domain_name ? domain_name : "null", result);
+    signal_flag(il2cpp_initialized);
+    return result;
+}
+
+static void *hooked_dlopen(const char *filename, int flags) {
+    auto handle = loader_dlopen(filename, flags, __builtin_return_address(0));
+    if (handle) {
+        hook_new_libraries();
+    }
+    return handle;
+}
+
+static void *hooked_android_dlopen_ext(const char *filename, int flags, const android_dlextinfo *extinfo) {
+    auto handle = loader_android_dlopen_ext(filename, flags, extinfo, __builtin_return_address(0));
+    if (handle) {
+        hook_new_libraries();
+    }
+    return handle;
+}
+
+static void *hooked_dlsym(void *handle, const char *symbol) {
+    auto result = loader_dlsym(handle, symbol, __builtin_return_address(0));
+    if (result && symbol && strcmp(symbol, "il2cpp_init") == 0 && result != (void *) hooked_il2cpp_init) {
+        orig_il2cpp_init = (int (*)(const char *)) result;
+        return (void *) hooked_il2cpp_init;
+    }
+    return result;
+}
+
+struct ImportHook {
+    const char *symbol;
+    void *func;
+};
+
+static const ImportHook import_hooks[] = {
+        {"dlopen",             (void *) hooked_dlopen},
+        {"android_dlopen_ext", (void *) hooked_android_dlopen_ext},
+        {"dlsym",              (void *) hooked_dlsym},
+};
+
+static void write_got(uintptr_t addr, void *func, uintptr_t relro_start, uintptr_t relro_end) {
+    auto slot = (void **) addr;
+    if (*slot == func) {
+        return;
+    }
+    // Outside of PT_GNU_RELRO the GOT is still writable
+    auto in_relro = addr >= relro_start && addr < relro_end;
+    auto page_size = (uintptr_t) sysconf(_SC_PAGESIZE);
+    auto page = (void *) (addr & ~(page_size - 1));
+    if (in_relro && mprotect(page, page_size, PROT_READ | PROT_WRITE) != 0) {
+        LOGW("mprotect GOT %p failed: %s", slot, strerror(errno));
+        return;
+    }
+    *slot = func;
+    if (in_relro) {
+        mprotect(page, page_size, PROT_READ);
+    }
+}
+
+static void hook_relocs(const dl_phdr_info *info, const ElfW(Sym) *symtab, const char *strtab,
+                        uintptr_t relocs, size_t relocs_size, uintptr_t relro_start, uintptr_t relro_end) {
+    if (!relocs || !relocs_size) {
+        return;
+    }
+    auto begin = (const ElfReloc *) relocs;
+    auto end = (const ElfReloc *) (relocs + relocs_size);
+    for (auto rel = begin; rel < end; ++rel) {
+        auto type = RELOC_TYPE(rel->r_info);
+        if (type != RELOC_JUMP_SLOT && type != RELOC_GLOB_DAT) {
+            continue;
+        }
+        auto sym_index = RELOC_SYM(rel->r_info);
+        if (!sym_index) {
+            continue;
+        }
+        auto name = strtab + symtab[sym_index].st_name;
+        for (auto &hook : import_hooks) {
+            if (strcmp(name, hook.symbol) == 0) {
+                write_got(info->dlpi_addr + rel->r_offset, hook.func, relro_start, relro_end);
+                break;
+            }
+        }
+    }
+}
+
+static void hook_imports(const dl_phdr_info *info) {
+    const ElfW(Dyn) *dynamic = nullptr;
+    uintptr_t relro_start = 0, relro_end = 0;
+    for (size_t i = 0; i < info->dlpi_phnum; ++i) {
+        auto phdr = &info->dlpi_phdr[i];
+        if (phdr->p_type == PT_DYNAMIC) {
+            dynamic = (const ElfW(Dyn) *) (info->dlpi_addr + phdr->p_vaddr);
+        } else if (phdr->p_type == PT_GNU_RELRO) {
+            relro_start = info->dlpi_addr + phdr->p_vaddr;
+            relro_end = relro_start + phdr->p_memsz;
+        }
+    }
+    if (!dynamic) {
+        return;
+    }
+    const ElfW(Sym) *symtab = nullptr;
+    const char *strtab = nullptr;
+    uintptr_t jmprel = 0, relocs = 0;
+    size_t jmprel_size = 0, relocs_size = 0;
+    for (auto entry = dynamic; entry->d_tag != DT_NULL; ++entry) {
+        switch (entry->d_tag) {
+            case DT_SYMTAB:
+                symtab = (const ElfW(Sym) *) (info->dlpi_addr + entry->d_un.d_ptr);
+                break;
+            case DT_STRTAB:
+                strtab = (const char *) (info->dlpi_addr + entry->d_un.d_ptr);
+                break;
+            case DT_JMPREL:
+                jmprel = info->dlpi_addr + entry->d_un.d_ptr;
+                break;
+            case DT_PLTRELSZ:
+                jmprel_size = entry->d_un.d_val;
+                break;
+            case DT_RELOC:
+                relocs = info->dlpi_addr + entry->d_un.d_ptr;
+                break;
+            case DT_RELOCSZ:
+                relocs_size = entry->d_un.d_val;
+                break;
+            default:
+                break;
+        }
+    }
+    if (!symtab || !strtab) {
+        return;
+    }
+    hook_relocs(info, symtab, strtab, jmprel, jmprel_size, relro_start, relro_end);
+    hook_relocs(info, symtab, strtab, relocs, relocs_size, relro_start, relro_end);
+}
+
+static bool is_self(const dl_phdr_info *info) {
+    auto addr = (uintptr_t) &load_watcher_install;
+    for (size_t i = 0; i < info->dlpi_phnum; ++i) {
+        auto phdr = &info->dlpi_phdr[i];
+        auto start = info->dlpi_addr + phdr->p_vaddr;
+        if (phdr->p_type == PT_LOAD && addr >= start && addr < start + phdr->p_memsz) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static int hook_iterate_cb(struct dl_phdr_info *info, size_t, void *arg) {
+    auto found_il2cpp = (bool *) arg;
+    auto it = patched_libs.find(info->dlpi_addr);
+    if (it != patched_libs.end() && it->second == info->dlpi_name) {
+        return 0;
+    }
+    patched_libs[info->dlpi_addr] = info->dlpi_name;
+    if (is_self(info)) {
+        return 0;
+    }
+    hook_imports(info);
+    auto name_len = strlen(info->dlpi_name);
+    if (name_len >= 12 && strcmp(info->dlpi_name + name_len - 12, "libil2cpp.so") == 0) {
+        LOGI("libil2cpp.so mapped: %s", info->dlpi_name);
+        *found_il2cpp = true;
+    }
+    return 0;
+}
+
+static void hook_new_libraries() {
+    bool found_il2cpp = false;
+    {
+        std::lock_guard<std::mutex> lock(patch_mutex);
+        xdl_iterate_phdr(hook_iterate_cb, &found_il2cpp, XDL_DEFAULT);
+    }
+    if (found_il2cpp) {
+        signal_flag(il2cpp_loaded);
+    }
+}
+
+bool load_watcher_install() {
+    auto linker = xdl_open(LINKER_BASENAME, XDL_DEFAULT);
+    if (!linker) {
+        LOGW("load watcher: %s not found", LINKER_BASENAME);
+        return false;
+    }
+    loader_dlopen = (void *(*)(const char *, int, const void *))
+            xdl_sym(linker, "__loader_dlopen", nullptr);
+    loader_android_dlopen_ext = (void *(*)(const char *, int, const android_dlextinfo *, const void *))
+            xdl_sym(linker, "__loader_android_dlopen_ext", nullptr);
+    loader_dlsym = (void *(*)(void *, const char *, const void *))
+            xdl_sym(linker, "__loader_dlsym", nullptr);
+    xdl_close(linker);
+    if (!loader_dlopen || !loader_android_dlopen_ext || !loader_dlsym) {
+        LOGW("load watcher: __loader_* not exported by %s, falling back to polling", LINKER_BASENAME);
+        return false;
+    }
+    {
+        std::lock_guard<std::mutex> lock(watcher_mutex);
+        watcher_installed = true;
+    }
+    hook_new_libraries();
+    LOGI("load watcher installed, %zu libraries hooked", patched_libs.size());
+    return true;
+}
+
+bool load_watcher_installed() {
+    std::lock_guard<std::mutex> lock(watcher_mutex);
+    return watcher_installed;
+}
+
+bool load_watcher_wait_loaded(int timeout_ms) {
+    return wait_flag(il2cpp_loaded, timeout_ms);
+}
+
+bool load_watcher_wait_initialized(int timeout_ms) {
+    return wait_flag(il2cpp_initialized, timeout_ms);
+}
@@ -0,0 +1,27 @@
+//
+// Notifies the dumper as soon as libil2cpp.so is mapped and il2cpp_init has returned, by hooking
+// dlopen/android_dlopen_ext/dlsym imports in the GOT of every loaded library.
+//
+
+#ifndef ZYGISK_IL2CPPDUMPER_LOAD_WATCHER_H
+#define ZYGISK_IL2CPPDUMPER_LOAD_WATCHER_H
+
+// Installs the hooks. Must run before the app starts loading its own libraries, i.e. from
+// postAppSpecialize. Returns false if the linker does not export __loader_* (Android < 8.0);
+// the wait functions then return false immediately and callers fall back to polling.
+bool load_watcher_install();
+
+// True once load_watcher_install succeeded.
+bool load_watcher_installed();
+
+// The waits below return as soon as the hook fires. Callers wait in short slices and check the
+// library or the VM themselves between slices: a hook that never fires then costs no more than
+// polling would.
+
+// Waits until libil2cpp.so is mapped. Returns false on timeout or if the watcher is not installed.
+bool load_watcher_wait_loaded(int timeout_ms);
+
+// Waits until il2cpp_init has returned. Returns false on timeout or if the watcher is not installed.
+bool load_watcher_wait_initialized(int timeout_ms);
+
+#endif //ZYGISK_IL2CPPDUMPER_LOAD_WATCHER_H
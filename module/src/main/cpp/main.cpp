@@ -8,8 +8,13 @@
 #include <cinttypes>
 #include <string> // Para std::string y strlen
 #include <cerrno> // Para strerror
+#include <unordered_set>
+#include <vector>
 
+#include "companion.h"
+#include "config.h"
 #include "hack.h"
+#include "load_watcher.h"
 #include "zygisk.hpp"
 // game.h ya no es necesario para GamePackageName, pero podría tener otras definiciones.
 // #include "game.h" 
@@ -61,7 +66,14 @@ public:
         }
 
         if (current_package_name_utf && current_app_data_dir_utf) {
-            processPreSpecialize(current_package_name_utf, current_app_data_dir_utf);
+            if (isTargetProcess(current_package_name_utf)) {
+                processPreSpecialize(current_package_name_utf, current_app_data_dir_utf);
+                loadConfig(current_package_name_utf, current_app_data_dir_utf, args->uid);
+            } else {
+                // No es un objetivo: sin hilo, sin mapeos, y Zygisk descarga el módulo tras la especialización.
+                enable_hack = false;
+                api->setOption(zygisk::DLCLOSE_MODULE_LIBRARY);
+            }
         } else {
             LOGE("Failed to get package name or app data directory.");
             enable_hack = false; // No se puede proceder sin esta información.
@@ -78,6 +90,9 @@ public:
     void postAppSpecialize(const AppSpecializeArgs *) override {
         if (enable_hack && game_data_dir) {
             LOGI("Preparing hack for: %s", game_data_dir);
+            config_set(config);
+            // Enganchar dlopen/dlsym antes de que la app cargue sus librerías.
+            load_watcher_install();
             // Pasamos los datos del .so ARM si estamos en x86 y se mapearon correctamente.
             std::thread hack_thread(hack_prepare, game_data_dir, arm_so_data, arm_so_length);
             hack_thread.detach();
@@ -105,6 +120,50 @@ private:
     char *game_data_dir; // Almacena el app_data_dir del proceso actual
     void *arm_so_data;   // Datos mapeados del .so ARM auxiliar en x86
     size_t arm_so_length;
+    DumperConfig config{};
+
+    // Lee targets.txt del directorio del módulo: un paquete por línea, '#' inicia un comentario.
+    // Sólo es accesible antes de la especialización, así que se lee aquí, una vez por proceso.
+    std::unordered_set<std::string> loadTargets() {
+        std::unordered_set<std::string> targets;
+        int dirfd = api->getModuleDir();
+        if (dirfd == -1) {
+            LOGE("Failed to get module directory descriptor.");
+            return targets;
+        }
+        std::vector<std::string> lines;
+        config_read_lines(dirfd, "targets.txt", &lines);
+        targets.insert(lines.begin(), lines.end());
+        return targets;
+    }
+
+    // Lee config.txt y, si el companion está habilitado, registra este proceso con él. connectCompanion()
+    // sólo funciona antes de la especialización; el volcado se conectará más tarde a su socket.
+    void loadConfig(const char *package_name, const char *app_data_dir, int uid) {
+        config_load(api->getModuleDir(), &config);
+        strlcpy(config.package_name, package_name, sizeof(config.package_name));
+        strlcpy(config.game_data_dir, app_data_dir, sizeof(config.game_data_dir));
+        if (config.companion) {
+            int fd = api->connectCompanion();
+            config.companion = fd != -1 && companion_register(fd, uid);
+            LOGI("Companion %s", config.companion ? "registered" : "not available, dumping in-process");
+        }
+    }
+
+    // Sin targets.txt (o vacío) se mantiene el comportamiento anterior: se intenta en todas las apps.
+    bool isTargetProcess(const char *process_name) {
+        auto targets = loadTargets();
+        if (targets.empty()) {
+            return true;
+        }
+        // Los procesos secundarios se llaman "paquete:proceso".
+        std::string package(process_name);
+        auto colon = package.find(':');
+        if (colon != std::string::npos) {
+            package.resize(colon);
+        }
+        return targets.count(package) > 0;
+    }
 
     void processPreSpecialize(const char *current_package_name, const char *current_app_data_dir) {
         LOGI("Zygisk Il2Cpp Dumper attempting to activate for package: %s", current_package_name);
@@ -139,6 +198,9 @@ private:
                 if (fstat(fd, &sb) == 0) {
                     arm_so_length = sb.st_size;
                     if (arm_so_length > 0) {
+                        // Zygisk (API v2) cierra cualquier fd abierto en preAppSpecialize y el directorio del
+                        // módulo deja de ser accesible tras la especialización, así que sólo un mapeo sobrevive.
+                        // Es de solo lectura; NativeBridgeLoad lo copia al memfd con write().
                         arm_so_data = mmap(nullptr, arm_so_length, PROT_READ, MAP_PRIVATE, fd, 0);
                         if (arm_so_data == MAP_FAILED) {
                             LOGE("mmap failed for %s: %s", path, strerror(errno));
@@ -182,4 +244,6 @@ private:
     }
 };
 
-REGISTER_ZYGISK_MODULE(MyModule)
\ No newline at end of file
+REGISTER_ZYGISK_MODULE(MyModule)
+
+REGISTER_ZYGISK_COMPANION(companion_handler)
@@ -0,0 +1,137 @@
+//
+// Fault-free access to this process's own memory.
+//
+
+#include "memory_io.h"
+#include <sys/uio.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+#include <linux/limits.h>
+
+bool memory_mappings(std::vector<MemoryMapping> *mappings) {
+    auto maps = fopen("/proc/self/maps", "re");
+    if (!maps) {
+        return false;
+    }
+    char line[PATH_MAX + 128];
+    while (fgets(line, sizeof(line), maps)) {
+        MemoryMapping mapping{};
+        int path_start = 0;
+        if (sscanf(line, "%" SCNxPTR "-%" SCNxPTR " %4s %" SCNx64 " %*s %*s %n", &mapping.start, &mapping.end,
+                   mapping.perms, &mapping.offset, &path_start) != 4) {
+            continue;
+        }
+        if (path_start > 0) {
+            mapping.path = line + path_start;
+            while (!mapping.path.empty() && (mapping.path.back() == '\n' || mapping.path.back() == ' ')) {
+                mapping.path.pop_back();
+            }
+        }
+        mappings->push_back(std::move(mapping));
+    }
+    fclose(maps);
+    return true;
+}
+
+size_t memory_read(uintptr_t address, void *buffer, size_t size) {
+    size_t done = 0;
+    while (done < size) {
+        iovec local{(char *) buffer + done, size - done};
+        iovec remote{(void *) (address + done), size - done};
+        auto n = process_vm_readv(getpid(), &local, 1, &remote, 1, 0);
+        if (n <= 0) {
+            break;
+        }
+        done += (size_t) n;
+    }
+    return done;
+}
+
+static bool read_exact(uintptr_t address, void *buffer, size_t size) {
+    return memory_read(address, buffer, size) == size;
+}
+
+static size_t count_symbols(uintptr_t bias, const MemoryDynamic &info) {
+    if (info.hash) {
+        uint32_t header[2];
+        return read_exact(bias + info.hash, header, sizeof(header)) ? header[1] : 0;
+    }
+    if (!info.gnu_hash) {
+        return 0;
+    }
+    // DT_GNU_HASH has no symbol count: the highest bucket's chain ends at the last symbol.
+    uint32_t header[4];
+    auto address = bias + info.gnu_hash;
+    if (!read_exact(address, header, sizeof(header))) {
+        return 0;
+    }
+    auto nbuckets = header[0], symoffset = header[1], bloom_size = header[2];
+    std::vector<uint32_t> buckets(nbuckets);
+    address += sizeof(header) + bloom_size * sizeof(ElfW(Addr));
+    if (!read_exact(address, buckets.data(), nbuckets * sizeof(uint32_t))) {
+        return 0;
+    }
+    auto last = buckets.empty() ? 0 : *std::max_element(buckets.begin(), buckets.end());
+    if (last < symoffset) {
+        return symoffset;
+    }
+    auto chain = address + nbuckets * sizeof(uint32_t);
+    for (uint32_t value = 0;; ++last) {
+        if (!read_exact(chain + (last - symoffset) * sizeof(uint32_t), &value, sizeof(value))) {
+            return 0;
+        }
+        if (value & 1) {
+            return last + 1;
+        }
+    }
+}
+
+MemoryDynamic memory_read_dynamic(uintptr_t bias, const ElfW(Phdr) *phdrs, size_t phnum) {
+    MemoryDynamic info;
+    for (size_t i = 0; i < phnum; ++i) {
+        auto &phdr = phdrs[i];
+        if (phdr.p_type == PT_DYNAMIC) {
+            info.dynamic = phdr.p_vaddr;
+            info.dynamic_size = phdr.p_memsz;
+        }
+    }
+    if (!info.dynamic) {
+        return info;
+    }
+    std::vector<ElfW(Dyn)> entries(info.dynamic_size / sizeof(ElfW(Dyn)));
+    entries.resize(memory_read(bias + info.dynamic, entries.data(), entries.size() * sizeof(ElfW(Dyn))) /
+                   sizeof(ElfW(Dyn)));
+    for (auto &entry: entries) {
+        switch (entry.d_tag) {
+            case DT_STRTAB:
+                info.strtab = entry.d_un.d_ptr;
+                break;
+            case DT_STRSZ:
+                info.strsz = entry.d_un.d_val;
+                break;
+            case DT_SYMTAB:
+                info.symtab = entry.d_un.d_ptr;
+                break;
+            case DT_HASH:
+                info.hash = entry.d_un.d_ptr;
+                break;
+            case DT_GNU_HASH:
+                info.gnu_hash = entry.d_un.d_ptr;
+                break;
+        }
+        if (entry.d_tag == DT_NULL) {
+            break;
+        }
+    }
+    // glibc rewrites these entries to absolute addresses, bionic leaves them as vaddrs.
+    for (auto address: {&info.strtab, &info.symtab, &info.hash, &info.gnu_hash}) {
+        if (bias && *address >= bias) {
+            *address -= bias;
+        }
+    }
+    info.symbols = count_symbols(bias, info);
+    return info;
+}
@@ -0,0 +1,87 @@
+//
+// Fault-free access to this process's own memory: reads go through process_vm_readv, which
+// reports a short read instead of raising SIGSEGV on guard pages or unmapped holes. Also the
+// /proc/self/maps and loaded-module lookups the memory scanners and dumpers start from.
+//
+
+#ifndef ZYGISK_IL2CPPDUMPER_MEMORY_IO_H
+#define ZYGISK_IL2CPPDUMPER_MEMORY_IO_H
+
+#include <link.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <cstring>
+#include <string>
+#include <vector>
+
+// ELF class and e_machine of the code running in this process, so of every library it loads.
+static constexpr uint8_t kElfClass = sizeof(void *) == 8 ? ELFCLASS64 : ELFCLASS32;
+#if defined(__aarch64__)
+static constexpr uint16_t kElfMachine = EM_AARCH64;
+#elif defined(__arm__)
+static constexpr uint16_t kElfMachine = EM_ARM;
+#elif defined(__x86_64__)
+static constexpr uint16_t kElfMachine = EM_X86_64;
+#elif defined(__i386__)
+static constexpr uint16_t kElfMachine = EM_386;
+#endif
+
+struct MemoryMapping {
+    uintptr_t start;
+    uintptr_t end;
+    char perms[5];   // "r-xp"
+    uint64_t offset; // file offset of start
+    std::string path; // empty for anonymous mappings
+};
+
+// Parses /proc/self/maps. Returns false if it cannot be read.
+bool memory_mappings(std::vector<MemoryMapping> *mappings);
+
+// Copies up to size bytes from address; returns how many could be read before the first fault.
+size_t memory_read(uintptr_t address, void *buffer, size_t size);
+
+// Tables of a loaded module's PT_DYNAMIC, as unrelocated vaddrs (0 when missing).
+struct MemoryDynamic {
+    ElfW(Addr) dynamic = 0;
+    ElfW(Xword) dynamic_size = 0;
+    ElfW(Addr) strtab = 0;
+    ElfW(Xword) strsz = 0;
+    ElfW(Addr) symtab = 0;
+    ElfW(Addr) hash = 0;
+    ElfW(Addr) gnu_hash = 0;
+    size_t symbols = 0; // .dynsym entries, from DT_HASH or a DT_GNU_HASH chain walk
+};
+
+// Reads the module's dynamic section through memory_read, so damaged or protected tables cannot fault.
+MemoryDynamic memory_read_dynamic(uintptr_t bias, const ElfW(Phdr) *phdrs, size_t phnum);
+
+// Calls found(const dl_phdr_info *) for the loaded module containing address or, when name is set,
+// the first one whose path contains name.
+template<typename F>
+void memory_find_module(uintptr_t address, const char *name, F &&found) {
+    struct Context {
+        uintptr_t address;
+        const char *name;
+        F *found;
+    } context{address, name, &found};
+    dl_iterate_phdr([](dl_phdr_info *info, size_t, void *data) {
+        auto context = (Context *) data;
+        bool match = false;
+        if (context->name) {
+            match = info->dlpi_name && strstr(info->dlpi_name, context->name);
+        } else {
+            for (int i = 0; i < info->dlpi_phnum && !match; ++i) {
+                auto &phdr = info->dlpi_phdr[i];
+                auto start = info->dlpi_addr + phdr.p_vaddr;
+                match = phdr.p_type == PT_LOAD && context->address >= start && context->address < start + phdr.p_memsz;
+            }
+        }
+        if (!match) {
+            return 0;
+        }
+        (*context->found)(info);
+        return 1;
+    }, &context);
+}
+
+#endif //ZYGISK_IL2CPPDUMPER_MEMORY_IO_H
@@ -0,0 +1,184 @@
+//
+// Finds global-metadata.dat in memory and writes it out.
+//
+
+#include "metadata_scan.h"
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+#include "log.h"
+#include "memory_io.h"
+#include "stats.h"
+
+static constexpr size_t kScanChunk = 4 * 1024 * 1024;
+// Largest header of any metadata version seen so far is well below this.
+static constexpr size_t kHeaderMax = 0x200;
+
+size_t metadata_find_sanity(const uint8_t *data, size_t size) {
+    size_t i = 0;
+#if defined(__SSE2__)
+    auto needle = _mm_set1_epi32((int) kMetadataSanity);
+    for (; i + 64 <= size; i += 64) {
+        auto a = _mm_cmpeq_epi32(_mm_loadu_si128((const __m128i *) (data + i)), needle);
+        auto b = _mm_cmpeq_epi32(_mm_loadu_si128((const __m128i *) (data + i + 16)), needle);
+        auto c = _mm_cmpeq_epi32(_mm_loadu_si128((const __m128i *) (data + i + 32)), needle);
+        auto d = _mm_cmpeq_epi32(_mm_loadu_si128((const __m128i *) (data + i + 48)), needle);
+        if (_mm_movemask_epi8(_mm_or_si128(_mm_or_si128(a, b), _mm_or_si128(c, d)))) {
+            break;
+        }
+    }
+#elif defined(__ARM_NEON)
+    auto needle = vdupq_n_u32(kMetadataSanity);
+    for (; i + 64 <= size; i += 64) {
+        auto a = vceqq_u32(vld1q_u32((const uint32_t *) (data + i)), needle);
+        auto b = vceqq_u32(vld1q_u32((const uint32_t *) (data + i + 16)), needle);
+        auto c = vceqq_u32(vld1q_u32((const uint32_t *) (data + i + 32)), needle);
+        auto d = vceqq_u32(vld1q_u32((const uint32_t *) (data + i + 48)), needle);
+        auto any = vorrq_u32(vorrq_u32(a, b), vorrq_u32(c, d));
+#if defined(__aarch64__)
+        if (vmaxvq_u32(any)) {
+            break;
+        }
+#else
+        auto folded = vorr_u32(vget_low_u32(any), vget_high_u32(any));
+        if (vget_lane_u32(folded, 0) | vget_lane_u32(folded, 1)) {
+            break;
+        }
+#endif
+    }
+#endif
+    // Tail, and the 64-byte block the vector loop stopped on.
+    for (; i + 4 <= size; i += 4) {
+        uint32_t word;
+        memcpy(&word, data + i, sizeof(word));
+        if (word == kMetadataSanity) {
+            return i;
+        }
+    }
+    return size;
+}
+
+// The header is the sanity word, the version and (offset, size) pairs of every table. The first
+// table starts right after the header in every version, which gives the header size; the blob
+// ends where the furthest table ends.
+static bool validate_header(const uint32_t *header, size_t header_bytes, uint64_t available, uint32_t *version,
+                            uint64_t *blob_size) {
+    auto header_size = header[2];
+    if (header[1] < 16 || header[1] > 64 || header_size < 0x40 || header_size > header_bytes ||
+        header_size % 8 != 0) {
+        return false;
+    }
+    uint64_t end = header_size;
+    for (uint32_t i = 2; i + 1 < header_size / 4; i += 2) {
+        uint64_t offset = header[i], size = header[i + 1];
+        if (offset < header_size || offset > available || size > available - offset) {
+            return false;
+        }
+        end = std::max(end, offset + size);
+    }
+    *version = header[1];
+    *blob_size = end;
+    return true;
+}
+
+static bool write_blob(const char *game_data_dir, uintptr_t address, uint64_t size, std::vector<uint8_t> &buffer) {
+    auto path = std::string(game_data_dir).append("/files/global-metadata.dat");
+    auto tmp_path = path + ".tmp";
+    int fd = open(tmp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd == -1) {
+        LOGE("Unable to open %s: %s", tmp_path.c_str(), strerror(errno));
+        return false;
+    }
+    // Chunk by chunk: the blob is never copied whole.
+    auto ok = true;
+    for (uint64_t done = 0; ok && done < size;) {
+        auto chunk = (size_t) std::min<uint64_t>(buffer.size(), size - done);
+        ok = memory_read(address + done, buffer.data(), chunk) == chunk &&
+             write(fd, buffer.data(), chunk) == (ssize_t) chunk;
+        done += chunk;
+    }
+    ok = close(fd) == 0 && ok;
+    if (!ok || rename(tmp_path.c_str(), path.c_str()) != 0) {
+        LOGE("Unable to write %s: %s", path.c_str(), strerror(errno));
+        unlink(tmp_path.c_str());
+        return false;
+    }
+    LOGI("global-metadata.dat written to %s", path.c_str());
+    return true;
+}
+
+static bool skip_mapping(const MemoryMapping &mapping) {
+    // Device memory (GPU, ashmem of other drivers) can be slow or unsafe to read.
+    return mapping.perms[0] != 'r' || mapping.perms[2] == 'x' || mapping.path.rfind("/dev/", 0) == 0 ||
+           mapping.path == "[vvar]" || mapping.path == "[vsyscall]";
+}
+
+bool metadata_dump(const char *game_data_dir) {
+    auto start = std::chrono::steady_clock::now();
+    std::vector<MemoryMapping> mappings;
+    if (!memory_mappings(&mappings)) {
+        LOGE("Unable to read /proc/self/maps");
+        return false;
+    }
+    // 16-byte aligned for the vector loads.
+    std::unique_ptr<uint32_t[]> storage(new uint32_t[kScanChunk / 4 + 4]);
+    auto chunk_data = (uint8_t *) (((uintptr_t) storage.get() + 15) & ~(uintptr_t) 15);
+    uint64_t scanned = 0;
+    uintptr_t found = 0;
+    uint32_t version = 0;
+    uint64_t blob_size = 0;
+    for (auto &mapping: mappings) {
+        if (found || skip_mapping(mapping)) {
+            continue;
+        }
+        for (auto address = mapping.start; !found && address < mapping.end;) {
+            auto size = memory_read(address, chunk_data, std::min<size_t>(kScanChunk, mapping.end - address));
+            if (size == 0) {
+                // Guard page or hole: continue with the next page.
+                address += getpagesize();
+                continue;
+            }
+            scanned += size;
+            for (size_t offset = 0; (offset = metadata_find_sanity(chunk_data + offset, size - offset) + offset) < size;
+                 offset += 4) {
+                uint32_t header[kHeaderMax / 4];
+                auto candidate = address + offset;
+                auto header_bytes = memory_read(candidate, header, sizeof(header));
+                if (header_bytes >= 16 &&
+                    validate_header(header, header_bytes, mapping.end - candidate, &version, &blob_size)) {
+                    found = candidate;
+                    break;
+                }
+            }
+            address += size;
+        }
+    }
+    auto elapsed_us = std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - start).count();
+    stats_record("metadata_scan_mb", "%.1f", scanned / 1048576.0);
+    stats_record("metadata_scan_ms", "%lld", (long long) (elapsed_us / 1000));
+    stats_record("metadata_scan_mb_per_sec", "%.1f", elapsed_us > 0 ? scanned / 1048576.0 * 1e6 / elapsed_us : 0.0);
+    if (!found) {
+        LOGW("global-metadata.dat not found in memory");
+        return false;
+    }
+    LOGI("global-metadata.dat v%u found at %" PRIxPTR ", %llu bytes", version, found, (unsigned long long) blob_size);
+    stats_record("metadata_version", "%u", version);
+    stats_record("metadata_size", "%llu", (unsigned long long) blob_size);
+    std::vector<uint8_t> buffer(1024 * 1024);
+    return write_blob(game_data_dir, found, blob_size, buffer);
+}
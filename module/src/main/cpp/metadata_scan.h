@@ -0,0 +1,26 @@
+//
+// Finds global-metadata.dat in memory and writes it to <game_data_dir>/files/global-metadata.dat.
+// Games that ship it encrypted decrypt it into memory before il2cpp_init, so the blob in memory is
+// the only readable copy.
+//
+// Readable, non-executable mappings are scanned for the 0xFAB11BAF sanity word with SSE2/NEON;
+// each hit is accepted only if the header that follows describes a blob that fits in the mapping.
+//
+
+#ifndef ZYGISK_IL2CPPDUMPER_METADATA_SCAN_H
+#define ZYGISK_IL2CPPDUMPER_METADATA_SCAN_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+static constexpr uint32_t kMetadataSanity = 0xFAB11BAF;
+
+// Offset of the first 4-byte aligned kMetadataSanity word in data, or size if there is none.
+// data must be 4-byte aligned.
+size_t metadata_find_sanity(const uint8_t *data, size_t size);
+
+// Scans the address space and streams the first valid metadata blob to disk. Returns false when
+// none was found or it could not be written.
+bool metadata_dump(const char *game_data_dir);
+
+#endif //ZYGISK_IL2CPPDUMPER_METADATA_SCAN_H
@@ -0,0 +1,223 @@
+//
+// Address-sorted index of the compiled methods.
+//
+
+#include "method_index.h"
+#include <sched.h>
+#include <algorithm>
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+#include <thread>
+#include "dump_format.h"
+#include "log.h"
+#include "memory_io.h"
+#include "stats.h"
+
+// Below this many entries a single std::sort beats starting threads.
+static constexpr size_t kParallelSortMin = 16 * 1024;
+
+static bool entry_less(const MethodIndexEntry &a, const MethodIndexEntry &b) {
+    if (a.rva != b.rva) {
+        return a.rva < b.rva;
+    }
+    return a.type_id != b.type_id ? a.type_id < b.type_id : a.method_id < b.method_id;
+}
+
+// Sorts equal slices on their own threads, then merges neighbouring slices pairwise, each level of
+// merges in parallel. The worker threads inherit the dump thread's nice value and affinity.
+static unsigned parallel_sort(std::vector<MethodIndexEntry> &items) {
+    cpu_set_t cpus;
+    unsigned threads = sched_getaffinity(0, sizeof(cpus), &cpus) == 0 ? CPU_COUNT(&cpus) : 1;
+    threads = std::clamp(threads, 1u, kMethodIndexMaxThreads);
+    if (threads == 1 || items.size() < kParallelSortMin) {
+        std::sort(items.begin(), items.end(), entry_less);
+        return 1;
+    }
+    std::vector<size_t> bounds;
+    for (unsigned i = 0; i <= threads; ++i) {
+        bounds.push_back(items.size() * i / threads);
+    }
+    auto begin = items.begin();
+    std::vector<std::thread> workers;
+    for (unsigned i = 0; i < threads; ++i) {
+        workers.emplace_back([&, i] {
+            std::sort(begin + (ptrdiff_t) bounds[i], begin + (ptrdiff_t) bounds[i + 1], entry_less);
+        });
+    }
+    for (auto &worker: workers) {
+        worker.join();
+    }
+    for (unsigned width = 1; width < threads; width *= 2) {
+        workers.clear();
+        for (unsigned i = 0; i + width < threads; i += 2 * width) {
+            auto middle = bounds[i + width], end = bounds[std::min(i + 2 * width, threads)];
+            workers.emplace_back([&, i, middle, end] {
+                std::inplace_merge(begin + (ptrdiff_t) bounds[i], begin + (ptrdiff_t) middle,
+                                   begin + (ptrdiff_t) end, entry_less);
+            });
+        }
+        for (auto &worker: workers) {
+            worker.join();
+        }
+    }
+    return threads;
+}
+
+// (RVA, size) of the sized function symbols in libil2cpp.so's .dynsym, sorted. Read once: xdl_addr
+// walks the whole symbol table on every call, far too slow for one lookup per method.
+static std::vector<std::pair<uint64_t, uint64_t>> function_symbols(const CodeInfo &code) {
+    std::vector<std::pair<uint64_t, uint64_t>> symbols;
+    MemoryDynamic dynamic;
+    // The companion builds an index for a library mapped in another process: whatever it finds at
+    // that address is not libil2cpp.so.
+    memory_find_module(code.code_start, nullptr, [&](const dl_phdr_info *info) {
+        if (info->dlpi_addr == code.base) {
+            dynamic = memory_read_dynamic(info->dlpi_addr, info->dlpi_phdr, info->dlpi_phnum);
+        }
+    });
+    if (!dynamic.symtab || !dynamic.symbols) {
+        return symbols;
+    }
+    std::vector<ElfW(Sym)> table(dynamic.symbols);
+    table.resize(memory_read(code.base + dynamic.symtab, table.data(), table.size() * sizeof(ElfW(Sym))) /
+                 sizeof(ElfW(Sym)));
+    for (auto &sym: table) {
+        if (ELF64_ST_TYPE(sym.st_info) == STT_FUNC && sym.st_shndx != SHN_UNDEF && sym.st_size) {
+            symbols.emplace_back(sym.st_value, sym.st_size);
+        }
+    }
+    std::sort(symbols.begin(), symbols.end());
+    return symbols;
+}
+
+void MethodIndex::clear() {
+    table.clear();
+    types.clear();
+}
+
+void MethodIndex::add_type(const TypeRecord &type) {
+    auto type_id = (uint32_t) types.size();
+    auto &info = types.emplace_back();
+    info.image_index = type.image_index;
+    info.name = format_full_name(type);
+    for (auto &method: type.methods) {
+        if (method.va) {
+            table.push_back({method.rva, 0, type_id, (uint32_t) info.methods.size(), 0});
+        }
+        info.methods.push_back(method.name);
+    }
+}
+
+void MethodIndex::build(const CodeInfo &code) {
+    code_start = code.code_start ? code.code_start - code.base : 0;
+    code_end = code.code_end ? code.code_end - code.base : 0;
+    auto start = std::chrono::steady_clock::now();
+    sort_threads = parallel_sort(table);
+    sort_us = std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - start).count();
+
+    auto symbols = function_symbols(code);
+    auto symbol = symbols.begin();
+    symbol_sizes = shared = 0;
+    for (size_t i = 0; i < table.size();) {
+        // [i, group_end) all point to the same body.
+        auto rva = table[i].rva;
+        auto group_end = i + 1;
+        while (group_end < table.size() && table[group_end].rva == rva) {
+            group_end++;
+        }
+        auto next = group_end < table.size() ? table[group_end].rva : code_end;
+        uint64_t size = next > rva ? next - rva : 0;
+        uint32_t flags = group_end - i > 1 ? METHOD_INDEX_SHARED : 0;
+        while (symbol != symbols.end() && symbol->first < rva) {
+            ++symbol;
+        }
+        if (symbol != symbols.end() && symbol->first == rva) {
+            size = symbol->second;
+            flags |= METHOD_INDEX_SIZE_SYMBOL;
+        }
+        for (; i < group_end; ++i) {
+            table[i].size = (uint32_t) std::min<uint64_t>(size, UINT32_MAX);
+            table[i].flags = flags;
+            symbol_sizes += (flags & METHOD_INDEX_SIZE_SYMBOL) != 0;
+            shared += (flags & METHOD_INDEX_SHARED) != 0;
+        }
+    }
+}
+
+bool MethodIndex::write_binary(const std::string &path) const {
+    auto file = fopen(path.c_str(), "we");
+    if (!file) {
+        LOGW("Unable to open %s", path.c_str());
+        return false;
+    }
+    MethodIndexHeader header{};
+    memcpy(header.magic, "IL2CPPMI", sizeof(header.magic));
+    header.version = kMethodIndexVersion;
+    header.entry_size = sizeof(MethodIndexEntry);
+    header.count = (uint32_t) table.size();
+    header.types = (uint32_t) types.size();
+    header.code_start = code_start;
+    header.code_end = code_end;
+    auto ok = fwrite(&header, sizeof(header), 1, file) == 1 &&
+              fwrite(table.data(), sizeof(MethodIndexEntry), table.size(), file) == table.size();
+    ok = fclose(file) == 0 && ok;
+    return ok;
+}
+
+// RFC 4180 quoting: generic names carry commas.
+static void append_csv_field(std::string *out, const std::string &value) {
+    if (value.find_first_of(",\"\n") == std::string::npos) {
+        out->append(value);
+        return;
+    }
+    out->push_back('"');
+    for (auto c: value) {
+        if (c == '"') {
+            out->push_back('"');
+        }
+        out->push_back(c);
+    }
+    out->push_back('"');
+}
+
+bool MethodIndex::write_csv(const std::string &path, const std::vector<std::string> &image_names) const {
+    auto file = fopen(path.c_str(), "we");
+    if (!file) {
+        LOGW("Unable to open %s", path.c_str());
+        return false;
+    }
+    std::string line = "rva,size,shared,size_from_symbol,type_id,method_id,image,type,method\n";
+    auto ok = true;
+    for (auto &entry: table) {
+        auto &type = types[entry.type_id];
+        char numbers[96];
+        snprintf(numbers, sizeof(numbers), "0x%" PRIx64 ",%u,%d,%d,%u,%u,", entry.rva, entry.size,
+                 (entry.flags & METHOD_INDEX_SHARED) != 0, (entry.flags & METHOD_INDEX_SIZE_SYMBOL) != 0,
+                 entry.type_id, entry.method_id);
+        line.append(numbers);
+        append_csv_field(&line, type.image_index < image_names.size() ? image_names[type.image_index] : "");
+        line.push_back(',');
+        append_csv_field(&line, type.name);
+        line.push_back(',');
+        append_csv_field(&line, type.methods[entry.method_id]);
+        line.push_back('\n');
+        if (line.size() >= 64 * 1024) {
+            ok = fwrite(line.data(), 1, line.size(), file) == line.size() && ok;
+            line.clear();
+        }
+    }
+    ok = fwrite(line.data(), 1, line.size(), file) == line.size() && ok;
+    ok = fclose(file) == 0 && ok;
+    return ok;
+}
+
+void MethodIndex::record_stats() const {
+    stats_record("method_index_entries", "%zu", table.size());
+    stats_record("method_index_shared", "%u", shared);
+    stats_record("method_index_symbol_sizes", "%u", symbol_sizes);
+    stats_record("method_index_sort_threads", "%u", sort_threads);
+    stats_record("method_index_sort_ms", "%.1f", (double) sort_us / 1000);
+}
@@ -0,0 +1,87 @@
+//
+// Address-sorted index of every compiled method, built in the game process from the dump records.
+//
+// Each entry carries the method's RVA, an estimated body size and the IDs of its owner: type_id is
+// the position of the type in the dump, method_id the position of the method in that type. Sizes
+// come from libil2cpp.so's own symbol table when it has one for the body, otherwise from the
+// distance to the next method pointer. Bodies shared by several methods (generic sharing, identical
+// code folding) are flagged on every entry that points to them.
+//
+// Written to <game_data_dir>/files/ as method_index.bin, a MethodIndexHeader followed by the packed
+// entries, and method_index.csv with the names resolved, for analysis.
+//
+
+#ifndef ZYGISK_IL2CPPDUMPER_METHOD_INDEX_H
+#define ZYGISK_IL2CPPDUMPER_METHOD_INDEX_H
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include "dump_record.h"
+
+enum MethodIndexFlags : uint32_t {
+    METHOD_INDEX_SHARED = 1u << 0,      // another method has the same body
+    METHOD_INDEX_SIZE_SYMBOL = 1u << 1, // size taken from the ELF symbol, not the next method pointer
+};
+
+struct MethodIndexEntry {
+    uint64_t rva;
+    uint32_t size;
+    uint32_t type_id;
+    uint32_t method_id;
+    uint32_t flags;
+};
+static_assert(sizeof(MethodIndexEntry) == 24, "method_index.bin layout");
+
+struct MethodIndexHeader {
+    char magic[8];        // "IL2CPPMI"
+    uint32_t version;     // kMethodIndexVersion
+    uint32_t entry_size;  // sizeof(MethodIndexEntry)
+    uint32_t count;
+    uint32_t types;
+    uint64_t code_start;  // executable segment, as RVAs
+    uint64_t code_end;
+};
+
+static constexpr uint32_t kMethodIndexVersion = 1;
+
+class MethodIndex {
+public:
+    struct Type {
+        uint32_t image_index;
+        std::string name;
+        std::vector<std::string> methods; // every method of the type, indexed by method_id
+    };
+
+    void clear();
+
+    // Assigns the next type_id to type and adds its methods that have a compiled body.
+    void add_type(const TypeRecord &type);
+
+    // Sorts the entries on up to kMethodIndexMaxThreads threads and estimates their sizes.
+    void build(const CodeInfo &code);
+
+    bool write_binary(const std::string &path) const;
+
+    bool write_csv(const std::string &path, const std::vector<std::string> &image_names) const;
+
+    void record_stats() const;
+
+    const std::vector<MethodIndexEntry> &entries() const { return table; }
+
+    const Type &type(uint32_t type_id) const { return types[type_id]; }
+
+private:
+    std::vector<MethodIndexEntry> table;
+    std::vector<Type> types;
+    uint64_t code_start = 0;
+    uint64_t code_end = 0;
+    unsigned sort_threads = 0;
+    int64_t sort_us = 0;
+    uint32_t symbol_sizes = 0;
+    uint32_t shared = 0;
+};
+
+static constexpr unsigned kMethodIndexMaxThreads = 4;
+
+#endif //ZYGISK_IL2CPPDUMPER_METHOD_INDEX_H
@@ -0,0 +1,227 @@
+//
+// perf map and ELF symbol files written from the method index.
+//
+
+#include "method_symbols.h"
+#include <elf.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+#include "log.h"
+
+// Symbols and names are handed to stdio in batches of this many bytes.
+static constexpr size_t kSymbolBuffer = 64 * 1024;
+
+std::string perf_map_path(pid_t pid) {
+    char path[64];
+    snprintf(path, sizeof(path), "/data/local/tmp/perf-%d.map", pid);
+    return path;
+}
+
+// "Namespace.Type::Method", as in dump.cs.
+static void append_name(const MethodIndex &index, const MethodIndexEntry &entry, std::string *out) {
+    auto &type = index.type(entry.type_id);
+    out->append(type.name).append("::").append(type.methods[entry.method_id]);
+}
+
+static size_t name_size(const MethodIndex &index, const MethodIndexEntry &entry) {
+    auto &type = index.type(entry.type_id);
+    return type.name.size() + 2 + type.methods[entry.method_id].size();
+}
+
+// The index leaves the size 0 when nothing bounds the body; symbols need a non-empty one.
+static uint64_t symbol_size(const MethodIndexEntry &entry) {
+    return std::max<uint64_t>(entry.size, 1);
+}
+
+// The index sorts a shared body's methods in dump order: the first one stays the primary name.
+static bool is_alias(const std::vector<MethodIndexEntry> &entries, size_t i) {
+    return i > 0 && entries[i - 1].rva == entries[i].rva;
+}
+
+// Writes to path + ".tmp" and renames it into place, readable by the shell user profilers run as.
+template<typename F>
+static bool write_atomically(const std::string &path, F &&write) {
+    auto tmp_path = path + ".tmp";
+    auto file = fopen(tmp_path.c_str(), "we");
+    if (!file) {
+        LOGW("Unable to open %s: %s", tmp_path.c_str(), strerror(errno));
+        return false;
+    }
+    auto ok = write(file);
+    ok = fflush(file) == 0 && !ferror(file) && ok;
+    ok = fclose(file) == 0 && ok;
+    if (!ok || chmod(tmp_path.c_str(), 0644) != 0 || rename(tmp_path.c_str(), path.c_str()) != 0) {
+        LOGW("Unable to write %s: %s", path.c_str(), strerror(errno));
+        unlink(tmp_path.c_str());
+        return false;
+    }
+    return true;
+}
+
+bool MethodSymbols::write_perf_map(const std::string &path) const {
+    return write_atomically(path, [&](FILE *file) {
+        auto &entries = table.entries();
+        std::string name;
+        for (size_t i = 0; i < entries.size(); ++i) {
+            if (!is_alias(entries, i)) {
+                name.clear();
+                append_name(table, entries[i], &name);
+                fprintf(file, "%" PRIx64 " %" PRIx64 " %s\n", code.base + entries[i].rva, symbol_size(entries[i]),
+                        name.c_str());
+            }
+        }
+        return true;
+    });
+}
+
+// Section indexes of the symbol file.
+enum : uint16_t {
+    SECTION_NULL,
+    SECTION_TEXT,
+    SECTION_BUILD_ID,
+    SECTION_SYMTAB,
+    SECTION_STRTAB,
+    SECTION_SHSTRTAB,
+    SECTION_COUNT,
+};
+
+static const char kSectionNames[] = "\0.text\0.note.gnu.build-id\0.symtab\0.strtab\0.shstrtab";
+static const uint32_t kSectionNameOffsets[SECTION_COUNT] = {0, 1, 7, 26, 34, 42};
+
+static uint64_t align_up(uint64_t value, uint64_t alignment) {
+    return (value + alignment - 1) & ~(alignment - 1);
+}
+
+// Layout: ELF header, build-id note, .symtab, .strtab, .shstrtab, section headers. Everything is
+// sized up front, so symbols and names are each streamed in one pass over the sorted table.
+template<typename Ehdr, typename Shdr, typename Sym, typename Nhdr>
+static bool write_elf_file(FILE *file, const MethodIndex &index, const CodeInfo &code) {
+    auto &table = index.entries();
+    std::string note;
+    if (!code.build_id.empty()) {
+        std::string id;
+        for (size_t i = 0; i + 1 < code.build_id.size(); i += 2) {
+            id.push_back((char) strtoul(code.build_id.substr(i, 2).c_str(), nullptr, 16));
+        }
+        Nhdr header{4, (decltype(header.n_descsz)) id.size(), NT_GNU_BUILD_ID};
+        note.append((const char *) &header, sizeof(header)).append("GNU", 4).append(id);
+        note.resize(align_up(note.size(), 4));
+    }
+    uint64_t names_size = 1;
+    for (auto &entry: table) {
+        names_size += name_size(index, entry) + 1;
+    }
+    auto note_offset = align_up(sizeof(Ehdr), 4);
+    auto symtab_offset = align_up(note_offset + note.size(), sizeof(Sym::st_value));
+    auto strtab_offset = symtab_offset + (table.size() + 1) * sizeof(Sym);
+    auto shstrtab_offset = strtab_offset + names_size;
+    auto shdrs_offset = align_up(shstrtab_offset + sizeof(kSectionNames), 8);
+
+    Ehdr ehdr{};
+    memcpy(ehdr.e_ident, ELFMAG, SELFMAG);
+    ehdr.e_ident[EI_CLASS] = code.elf_class;
+    ehdr.e_ident[EI_DATA] = ELFDATA2LSB;
+    ehdr.e_ident[EI_VERSION] = EV_CURRENT;
+    ehdr.e_type = ET_DYN;
+    ehdr.e_machine = (uint16_t) code.machine;
+    ehdr.e_version = EV_CURRENT;
+    ehdr.e_shoff = shdrs_offset;
+    ehdr.e_ehsize = sizeof(Ehdr);
+    ehdr.e_shentsize = sizeof(Shdr);
+    ehdr.e_shnum = SECTION_COUNT;
+    ehdr.e_shstrndx = SECTION_SHSTRTAB;
+
+    Shdr shdrs[SECTION_COUNT]{};
+    for (int i = 0; i < SECTION_COUNT; ++i) {
+        shdrs[i].sh_name = kSectionNameOffsets[i];
+    }
+    // The code itself stays in libil2cpp.so: .text only gives the symbols a section to live in.
+    shdrs[SECTION_TEXT].sh_type = SHT_NOBITS;
+    shdrs[SECTION_TEXT].sh_flags = SHF_ALLOC | SHF_EXECINSTR;
+    if (code.code_end) {
+        shdrs[SECTION_TEXT].sh_addr = code.code_start - code.base;
+        shdrs[SECTION_TEXT].sh_size = code.code_end - code.code_start;
+    } else if (!table.empty()) {
+        shdrs[SECTION_TEXT].sh_addr = table.front().rva;
+        shdrs[SECTION_TEXT].sh_size = table.back().rva + symbol_size(table.back()) - table.front().rva;
+    }
+    shdrs[SECTION_TEXT].sh_offset = note_offset;
+    shdrs[SECTION_TEXT].sh_addralign = 4;
+    shdrs[SECTION_BUILD_ID].sh_type = SHT_NOTE;
+    shdrs[SECTION_BUILD_ID].sh_flags = SHF_ALLOC;
+    shdrs[SECTION_BUILD_ID].sh_offset = note_offset;
+    shdrs[SECTION_BUILD_ID].sh_size = note.size();
+    shdrs[SECTION_BUILD_ID].sh_addralign = 4;
+    shdrs[SECTION_SYMTAB].sh_type = SHT_SYMTAB;
+    shdrs[SECTION_SYMTAB].sh_offset = symtab_offset;
+    shdrs[SECTION_SYMTAB].sh_size = (table.size() + 1) * sizeof(Sym);
+    shdrs[SECTION_SYMTAB].sh_link = SECTION_STRTAB;
+    shdrs[SECTION_SYMTAB].sh_info = 1; // first global symbol
+    shdrs[SECTION_SYMTAB].sh_addralign = sizeof(Sym::st_value);
+    shdrs[SECTION_SYMTAB].sh_entsize = sizeof(Sym);
+    shdrs[SECTION_STRTAB].sh_type = SHT_STRTAB;
+    shdrs[SECTION_STRTAB].sh_offset = strtab_offset;
+    shdrs[SECTION_STRTAB].sh_size = names_size;
+    shdrs[SECTION_STRTAB].sh_addralign = 1;
+    shdrs[SECTION_SHSTRTAB].sh_type = SHT_STRTAB;
+    shdrs[SECTION_SHSTRTAB].sh_offset = shstrtab_offset;
+    shdrs[SECTION_SHSTRTAB].sh_size = sizeof(kSectionNames);
+    shdrs[SECTION_SHSTRTAB].sh_addralign = 1;
+
+    std::string buffer;
+    buffer.reserve(kSymbolBuffer + 4096);
+    auto flush = [&]() {
+        auto ok = fwrite(buffer.data(), 1, buffer.size(), file) == buffer.size();
+        buffer.clear();
+        return ok;
+    };
+    buffer.append((const char *) &ehdr, sizeof(ehdr));
+    buffer.resize(note_offset);
+    buffer.append(note);
+    buffer.resize(symtab_offset);
+    buffer.append(sizeof(Sym), '\0');
+    uint32_t name_offset = 1;
+    for (auto &entry: table) {
+        Sym sym{};
+        sym.st_name = name_offset;
+        sym.st_value = entry.rva;
+        sym.st_size = symbol_size(entry);
+        sym.st_info = ELF64_ST_INFO(STB_GLOBAL, STT_FUNC);
+        sym.st_shndx = SECTION_TEXT;
+        buffer.append((const char *) &sym, sizeof(sym));
+        name_offset += (uint32_t) name_size(index, entry) + 1;
+        if (buffer.size() >= kSymbolBuffer && !flush()) {
+            return false;
+        }
+    }
+    buffer.push_back('\0');
+    for (auto &entry: table) {
+        append_name(index, entry, &buffer);
+        buffer.push_back('\0');
+        if (buffer.size() >= kSymbolBuffer && !flush()) {
+            return false;
+        }
+    }
+    buffer.append(kSectionNames, sizeof(kSectionNames));
+    buffer.resize(buffer.size() + (shdrs_offset - shstrtab_offset - sizeof(kSectionNames)));
+    buffer.append((const char *) shdrs, sizeof(shdrs));
+    return flush();
+}
+
+bool MethodSymbols::write_elf(const std::string &path) const {
+    if (code.elf_class != ELFCLASS32 && code.elf_class != ELFCLASS64) {
+        LOGW("symbols: unknown ELF class of libil2cpp.so");
+        return false;
+    }
+    return write_atomically(path, [&](FILE *file) {
+        if (code.elf_class == ELFCLASS64) {
+            return write_elf_file<Elf64_Ehdr, Elf64_Shdr, Elf64_Sym, Elf64_Nhdr>(file, table, code);
+        }
+        return write_elf_file<Elf32_Ehdr, Elf32_Shdr, Elf32_Sym, Elf32_Nhdr>(file, table, code);
+    });
+}
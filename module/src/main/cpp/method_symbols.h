@@ -0,0 +1,42 @@
+//
+// Symbol files written from the MethodIndex of the compiled il2cpp methods:
+//  - perf-<pid>.map for simpleperf and Linux perf: "start size name" lines, in hex;
+//  - libil2cpp.so.debug: an ELF with only .symtab/.strtab, one STT_FUNC per method at its RVA, and
+//    libil2cpp.so's build-id, for debuggers and addr2line to load next to the stripped library.
+//
+// Entries and sizes are the index's: the order, the size estimate and which bodies are shared are
+// decided in one place for every consumer. In the game the index is the one il2cpp_dump builds for
+// the method index files and the symbolizer; the companion builds its own from the records.
+//
+
+#ifndef ZYGISK_IL2CPPDUMPER_METHOD_SYMBOLS_H
+#define ZYGISK_IL2CPPDUMPER_METHOD_SYMBOLS_H
+
+#include <stdint.h>
+#include <sys/types.h>
+#include <string>
+#include <vector>
+#include "dump_record.h"
+#include "method_index.h"
+
+// Where profilers look for the map of pid.
+std::string perf_map_path(pid_t pid);
+
+// Writes the symbol files of a built index. Both must outlive it.
+class MethodSymbols {
+public:
+    MethodSymbols(const MethodIndex &index, const CodeInfo &code) : table(index), code(code) {}
+
+    // Only the first method of a shared body is listed: the map must not overlap.
+    bool write_perf_map(const std::string &path) const;
+
+    bool write_elf(const std::string &path) const;
+
+    size_t size() const { return table.entries().size(); }
+
+private:
+    const MethodIndex &table;
+    const CodeInfo &code;
+};
+
+#endif //ZYGISK_IL2CPPDUMPER_METHOD_SYMBOLS_H
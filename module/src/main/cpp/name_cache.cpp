@@ -0,0 +1,16 @@
+//
+// Memoized names of il2cpp runtime objects, keyed by the runtime pointer.
+//
+
+#include "name_cache.h"
+#include "stats.h"
+
+void NameCache::record_stats(const char *prefix) const {
+    std::string key(prefix);
+    auto length = key.size();
+    stats_record(key.append("_hits").c_str(), "%u", hits);
+    key.resize(length);
+    stats_record(key.append("_misses").c_str(), "%u", misses);
+    key.resize(length);
+    stats_record(key.append("_entries").c_str(), "%zu", names.size());
+}
@@ -0,0 +1,37 @@
+//
+// Memoized names of il2cpp runtime objects (types, attribute classes), keyed by the runtime pointer.
+// Each distinct name is resolved once; the same types show up in thousands of signatures.
+//
+
+#ifndef ZYGISK_IL2CPPDUMPER_NAME_CACHE_H
+#define ZYGISK_IL2CPPDUMPER_NAME_CACHE_H
+
+#include <stdint.h>
+#include <string>
+#include <unordered_map>
+
+class NameCache {
+public:
+    // Returns the cached name of key, calling resolve() to produce it on the first lookup.
+    template<typename F>
+    const std::string &get(const void *key, F &&resolve) {
+        auto it = names.find(key);
+        if (it != names.end()) {
+            hits++;
+            return it->second;
+        }
+        misses++;
+        return names.emplace(key, resolve()).first->second;
+    }
+
+    // Records <prefix>_hits, <prefix>_misses and <prefix>_entries in the stats.
+    void record_stats(const char *prefix) const;
+
+    uint32_t hits = 0;
+    uint32_t misses = 0;
+
+private:
+    std::unordered_map<const void *, std::string> names;
+};
+
+#endif //ZYGISK_IL2CPPDUMPER_NAME_CACHE_H
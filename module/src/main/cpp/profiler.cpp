@@ -0,0 +1,410 @@
+//
+// Sampling profiler over il2cpp's frame walker.
+//
+
+#include "profiler.h"
+#include <sched.h>
+#include <sys/resource.h>
+#include <unistd.h>
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include "log.h"
+#include "memory_io.h"
+#include "stats.h"
+#include "il2cpp-class.h"
+
+// The API pointers are defined and resolved in il2cpp_dump.cpp.
+#define DO_API(r, n, p) extern r (*n) p
+
+#include "il2cpp-api-functions.h"
+
+#undef DO_API
+
+static constexpr unsigned kProfilerMaxHz = 1000;
+// How often the rings are drained. Each ring holds twice what a thread produces in that time.
+static constexpr auto kDrainInterval = std::chrono::milliseconds(250);
+// Thread pointers read from il2cpp's list per tick.
+static constexpr size_t kSnapshotThreads = 256;
+
+// Every il2cpp version starts Il2CppStackFrameInfo with the method; later ones append fields.
+struct ProfilerFrameInfo {
+    const MethodInfo *method;
+};
+
+struct ProfilerSample {
+    uint32_t depth;
+    bool truncated;
+    const MethodInfo *frames[kProfilerMaxDepth]; // innermost first, as the walk reports them
+};
+
+// Written only by the sampler, read only by the draining thread.
+class ProfilerRing {
+public:
+    explicit ProfilerRing(uint32_t capacity) : samples(capacity), mask(capacity - 1) {}
+
+    // The slot for the next sample, or nullptr when the reader has fallen behind.
+    ProfilerSample *reserve() {
+        auto h = head.load(std::memory_order_relaxed);
+        if (h - tail.load(std::memory_order_acquire) == samples.size()) {
+            return nullptr;
+        }
+        return &samples[h & mask];
+    }
+
+    void commit() {
+        head.store(head.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+    // The oldest sample not yet consumed, or nullptr.
+    const ProfilerSample *peek() const {
+        auto t = tail.load(std::memory_order_relaxed);
+        return t == head.load(std::memory_order_acquire) ? nullptr : &samples[t & mask];
+    }
+
+    void pop() {
+        tail.store(tail.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+private:
+    std::vector<ProfilerSample> samples;
+    uint32_t mask;
+    alignas(64) std::atomic<uint32_t> head{0};
+    alignas(64) std::atomic<uint32_t> tail{0};
+};
+
+struct ProfilerState {
+    uint32_t ring_capacity;
+    std::chrono::nanoseconds period;
+    std::atomic<bool> running{true};
+    // Class of managed Thread objects: a list entry pointing anywhere else is not a live thread.
+    const Il2CppClass *thread_class = nullptr;
+    // Slot i follows owners[i] until the thread leaves the list; the rings are published once and live
+    // until the profile is written.
+    std::array<const Il2CppThread *, kProfilerMaxThreads> owners{};
+    std::array<bool, kProfilerMaxThreads> retired{};
+    std::array<std::atomic<ProfilerRing *>, kProfilerMaxThreads> rings{};
+    // Sampler counters, read after it is joined.
+    uint64_t ticks = 0;
+    uint64_t late_ticks = 0;
+    uint64_t samples = 0;
+    uint64_t dropped = 0;
+    uint64_t empty = 0;
+    uint64_t untracked = 0;
+    int64_t tick_ns_total = 0;
+    int64_t tick_ns_max = 0;
+    int64_t cpu_ns = 0;
+};
+
+static int64_t thread_cpu_ns() {
+    timespec now{};
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now);
+    return (int64_t) now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+static uint32_t ring_capacity(unsigned hz) {
+    auto per_drain = (uint32_t) (hz * kDrainInterval.count() / 1000);
+    uint32_t capacity = 16;
+    while (capacity < per_drain * 2) {
+        capacity *= 2;
+    }
+    return capacity;
+}
+
+static void collect_frame(const Il2CppStackFrameInfo *info, void *user_data) {
+    auto sample = (ProfilerSample *) user_data;
+    if (sample->depth < kProfilerMaxDepth) {
+        sample->frames[sample->depth++] = ((const ProfilerFrameInfo *) info)->method;
+    } else {
+        sample->truncated = true;
+    }
+}
+
+static int find_slot(const ProfilerState *state, const Il2CppThread *thread) {
+    for (unsigned i = 0; i < kProfilerMaxThreads && state->owners[i]; ++i) {
+        if (state->owners[i] == thread && !state->retired[i]) {
+            return (int) i;
+        }
+    }
+    return -1;
+}
+
+static void track(ProfilerState *state, const Il2CppThread *thread) {
+    for (unsigned i = 0; i < kProfilerMaxThreads; ++i) {
+        if (!state->owners[i]) {
+            state->owners[i] = thread;
+            state->rings[i].store(new ProfilerRing(state->ring_capacity), std::memory_order_release);
+            return;
+        }
+    }
+    state->untracked++;
+}
+
+// Copies il2cpp's list of attached threads, keeping the entries that still are managed Thread objects.
+// The list is read through memory_read: a thread stopped in the middle of attaching or detaching may
+// have left it half updated.
+static size_t snapshot_threads(const ProfilerState *state, const Il2CppThread *self, Il2CppThread **threads) {
+    size_t count = 0;
+    auto attached = il2cpp_thread_get_all_attached_threads(&count);
+    count = attached ? std::min(count, kSnapshotThreads) : 0;
+    count = memory_read((uintptr_t) attached, threads, count * sizeof(threads[0])) / sizeof(threads[0]);
+    size_t kept = 0;
+    for (size_t i = 0; i < count; ++i) {
+        auto thread = threads[i];
+        const Il2CppClass *klass = nullptr;
+        if (thread && thread != self && memory_read((uintptr_t) thread, &klass, sizeof(klass)) == sizeof(klass) &&
+            klass == state->thread_class) {
+            threads[kept++] = thread;
+        }
+    }
+    return kept;
+}
+
+static void sample_threads(ProfilerState *state, const Il2CppThread *self) {
+    Il2CppThread *threads[kSnapshotThreads];
+    std::array<bool, kProfilerMaxThreads> seen{};
+    // While the GC world is stopped every attached thread is suspended, so no stack changes under the
+    // walk, and threads attaching or detaching wait for the GC lock. Nothing may allocate until it
+    // restarts: a suspended thread can hold the malloc lock.
+    il2cpp_stop_gc_world();
+    auto count = snapshot_threads(state, self, threads);
+    size_t unknown = 0;
+    for (size_t i = 0; i < count; ++i) {
+        auto thread = threads[i];
+        auto slot = find_slot(state, thread);
+        if (slot < 0) {
+            // Rings are allocated after the world restarts; the thread is sampled from the next tick.
+            threads[unknown++] = thread;
+            continue;
+        }
+        seen[slot] = true;
+        auto ring = state->rings[slot].load(std::memory_order_relaxed);
+        auto sample = ring->reserve();
+        if (!sample) {
+            state->dropped++;
+            continue;
+        }
+        sample->depth = 0;
+        sample->truncated = false;
+        il2cpp_thread_walk_frame_stack(thread, collect_frame, sample);
+        if (!sample->depth) {
+            state->empty++;
+            continue;
+        }
+        ring->commit();
+        state->samples++;
+    }
+    il2cpp_start_gc_world();
+    // A detached thread's slot is never reused: a new thread allocated at the same address gets its own.
+    for (unsigned i = 0; i < kProfilerMaxThreads && state->owners[i]; ++i) {
+        state->retired[i] = state->retired[i] || !seen[i];
+    }
+    for (size_t i = 0; i < unknown; ++i) {
+        track(state, threads[i]);
+    }
+}
+
+// SCHED_IDLE or SCHED_BATCH, inherited from the dump thread when dump_sched sets them, would let the
+// game starve the sampler, bias the profile toward the moments the game is idle and, with the world
+// stopped, leave the whole game waiting on a preempted sampler.
+static void sampler_priority() {
+    sched_param param{};
+    if (sched_getscheduler(0) != SCHED_OTHER && sched_setscheduler(0, SCHED_OTHER, &param) != 0) {
+        LOGW("profiler: sched_setscheduler failed: %s", strerror(errno));
+    }
+    if (setpriority(PRIO_PROCESS, gettid(), 0) != 0) {
+        LOGW("profiler: setpriority failed: %s", strerror(errno));
+    }
+}
+
+static void sampler_main(ProfilerState *state) {
+    sampler_priority();
+    il2cpp_thread_attach(il2cpp_domain_get());
+    auto self = il2cpp_thread_current();
+    state->thread_class = il2cpp_object_get_class((Il2CppObject *) self);
+    auto cpu_start = thread_cpu_ns();
+    auto next = std::chrono::steady_clock::now();
+    while (state->running.load(std::memory_order_relaxed)) {
+        next += state->period;
+        std::this_thread::sleep_until(next);
+        auto start = std::chrono::steady_clock::now();
+        if (start - next > state->period) {
+            // Woken too late: skip the missed ticks instead of sampling in a burst.
+            state->late_ticks++;
+            next = start;
+        }
+        sample_threads(state, self);
+        auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now() - start).count();
+        state->ticks++;
+        state->tick_ns_total += elapsed;
+        state->tick_ns_max = std::max<int64_t>(state->tick_ns_max, elapsed);
+    }
+    state->cpu_ns = thread_cpu_ns() - cpu_start;
+    il2cpp_thread_detach(self);
+}
+
+// Counts samples per distinct stack. The key is the thread slot, the truncated flag and the raw frame
+// pointers; names are only resolved when writing.
+class FoldedStacks {
+public:
+    void add(uint8_t slot, const ProfilerSample &sample) {
+        key.assign(1, (char) slot);
+        key.push_back(sample.truncated);
+        key.append((const char *) sample.frames, sample.depth * sizeof(sample.frames[0]));
+        counts[key]++;
+    }
+
+    size_t size() const { return counts.size(); }
+
+    bool write(const std::string &path) {
+        auto file = fopen(path.c_str(), "we");
+        if (!file) {
+            LOGW("Unable to open %s: %s", path.c_str(), strerror(errno));
+            return false;
+        }
+        std::string line;
+        for (auto &[stack, count]: counts) {
+            auto depth = (stack.size() - 2) / sizeof(const MethodInfo *);
+            line.assign("thread-").append(std::to_string((uint8_t) stack[0]));
+            if (stack[1]) {
+                line.append(";[truncated]");
+            }
+            // The folded format lists the root first.
+            for (auto i = depth; i-- > 0;) {
+                const MethodInfo *method;
+                memcpy(&method, stack.data() + 2 + i * sizeof(method), sizeof(method));
+                line.push_back(';');
+                line.append(name_of(method));
+            }
+            line.push_back(' ');
+            line.append(std::to_string(count)).push_back('\n');
+            fwrite(line.data(), 1, line.size(), file);
+        }
+        auto ok = !ferror(file);
+        ok = fclose(file) == 0 && ok;
+        return ok;
+    }
+
+private:
+    const std::string &name_of(const MethodInfo *method) {
+        auto [it, inserted] = names.try_emplace(method);
+        if (!inserted) {
+            return it->second;
+        }
+        auto &name = it->second;
+        auto klass = method ? il2cpp_method_get_class(method) : nullptr;
+        if (!klass) {
+            return name.assign("[unknown]");
+        }
+        name.assign(il2cpp_class_get_name(klass));
+        while (il2cpp_class_get_declaring_type) {
+            auto declaring = il2cpp_class_get_declaring_type(klass);
+            if (!declaring) {
+                break;
+            }
+            name.insert(0, ".").insert(0, il2cpp_class_get_name(declaring));
+            klass = declaring;
+        }
+        auto namespaze = il2cpp_class_get_namespace(klass);
+        if (namespaze && *namespaze) {
+            name.insert(0, ".").insert(0, namespaze);
+        }
+        name.append("::").append(il2cpp_method_get_name(method));
+        // ';' separates frames and the count follows the last space.
+        std::replace(name.begin(), name.end(), ';', ':');
+        return name;
+    }
+
+    std::string key;
+    std::unordered_map<std::string, uint64_t> counts;
+    std::unordered_map<const MethodInfo *, std::string> names;
+};
+
+static void drain(ProfilerState *state, FoldedStacks *stacks) {
+    for (unsigned i = 0; i < kProfilerMaxThreads; ++i) {
+        auto ring = state->rings[i].load(std::memory_order_acquire);
+        if (!ring) {
+            break;
+        }
+        for (auto sample = ring->peek(); sample; sample = ring->peek()) {
+            stacks->add((uint8_t) i, *sample);
+            ring->pop();
+        }
+    }
+}
+
+bool profiler_run(const char *game_data_dir, const DumperConfig &config) {
+    if (!il2cpp_thread_get_all_attached_threads || !il2cpp_thread_walk_frame_stack || !il2cpp_thread_current) {
+        LOGW("profiler: il2cpp thread API not available");
+        return false;
+    }
+    // Without stopping the world the thread list and the stacks would be read while they change.
+    if (!il2cpp_stop_gc_world || !il2cpp_start_gc_world) {
+        LOGW("profiler: il2cpp_stop_gc_world not available, not profiling");
+        return false;
+    }
+    auto hz = std::clamp<unsigned>(config.profiler_hz, 1, kProfilerMaxHz);
+    auto seconds = std::max(config.profiler_seconds, 1);
+    LOGI("profiler: sampling managed threads at %u Hz for %d s", hz, seconds);
+    auto state = std::make_unique<ProfilerState>();
+    state->ring_capacity = ring_capacity(hz);
+    state->period = std::chrono::nanoseconds(1000000000 / hz);
+    FoldedStacks stacks;
+    auto cpu_start = thread_cpu_ns();
+    auto start = std::chrono::steady_clock::now();
+    std::thread sampler(sampler_main, state.get());
+    auto deadline = start + std::chrono::seconds(seconds);
+    while (std::chrono::steady_clock::now() < deadline) {
+        std::this_thread::sleep_for(std::min<std::chrono::steady_clock::duration>(
+                kDrainInterval, deadline - std::chrono::steady_clock::now()));
+        drain(state.get(), &stacks);
+    }
+    state->running.store(false, std::memory_order_relaxed);
+    sampler.join();
+    drain(state.get(), &stacks);
+    auto wall_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - start).count();
+
+    auto path = std::string(game_data_dir).append("/files/profile.folded");
+    auto ok = stacks.write(path);
+    auto drain_cpu_ns = thread_cpu_ns() - cpu_start;
+    unsigned threads = 0;
+    for (auto &ring: state->rings) {
+        auto r = ring.load(std::memory_order_relaxed);
+        threads += r != nullptr;
+        delete r;
+    }
+    if (ok) {
+        LOGI("profiler: %llu samples, %zu stacks -> %s", (unsigned long long) state->samples, stacks.size(),
+             path.c_str());
+    }
+    if (!state->samples && state->empty) {
+        LOGW("profiler: il2cpp_thread_walk_frame_stack returned no frames, "
+             "this libil2cpp.so cannot walk other threads");
+    }
+    stats_record("profiler_hz", "%u", hz);
+    stats_record("profiler_threads", "%u", threads);
+    stats_record("profiler_ticks", "%llu", (unsigned long long) state->ticks);
+    stats_record("profiler_late_ticks", "%llu", (unsigned long long) state->late_ticks);
+    stats_record("profiler_samples", "%llu", (unsigned long long) state->samples);
+    stats_record("profiler_empty_walks", "%llu", (unsigned long long) state->empty);
+    stats_record("profiler_dropped", "%llu", (unsigned long long) state->dropped);
+    stats_record("profiler_untracked", "%llu", (unsigned long long) state->untracked);
+    stats_record("profiler_stacks", "%zu", stacks.size());
+    stats_record("profiler_tick_us_avg", "%.1f",
+                 state->ticks ? (double) state->tick_ns_total / (double) state->ticks / 1000 : 0.0);
+    stats_record("profiler_tick_us_max", "%.1f", (double) state->tick_ns_max / 1000);
+    stats_record("profiler_sampler_cpu_pct", "%.2f", 100.0 * (double) state->cpu_ns / (double) wall_ns);
+    stats_record("profiler_drain_cpu_pct", "%.2f", 100.0 * (double) drain_cpu_ns / (double) wall_ns);
+    return ok;
+}
@@ -0,0 +1,34 @@
+//
+// Sampling profiler for the managed threads, run after the dump when profiler_hz is set.
+//
+// A sampler thread wakes profiler_hz times a second, stops the GC world and walks the managed stack of
+// every thread attached to the il2cpp domain into that thread's ring buffer. il2cpp has no lock around
+// its thread list nor a way to walk a running thread, so only stopped threads are ever read; each tick
+// therefore pauses the whole game for the duration of the walks (profiler_tick_us_* in the stats), and
+// libil2cpp.so builds without il2cpp_stop_gc_world are not profiled. A thread suspended halfway through
+// attaching may still leave a stale entry in the list: entries are read with memory_read and kept only
+// if they point to a Thread object.
+//
+// The calling thread drains the rings, which are single-producer/single-consumer and lock-free, so
+// name resolution and aggregation never delay a tick. After profiler_seconds it writes <game_data_dir>/files/profile.folded, one
+// "thread;Outer::Method;...;Inner::Method count" line per distinct stack, the folded format read by
+// flamegraph.pl, speedscope and similar tools. Sample counts and the profiler's own cost (time per
+// tick, CPU of both threads) go to dump_stats.txt.
+//
+// Must run on a thread attached to the il2cpp domain, after il2cpp_api_init.
+//
+
+#ifndef ZYGISK_IL2CPPDUMPER_PROFILER_H
+#define ZYGISK_IL2CPPDUMPER_PROFILER_H
+
+#include "config.h"
+
+// Frames kept per sample, innermost first; deeper stacks are cut at the root side.
+static constexpr unsigned kProfilerMaxDepth = 64;
+// Threads followed over the whole profile; threads attached after that are not sampled.
+static constexpr unsigned kProfilerMaxThreads = 64;
+
+// Profiles for config.profiler_seconds and returns once profile.folded is written.
+bool profiler_run(const char *game_data_dir, const DumperConfig &config);
+
+#endif //ZYGISK_IL2CPPDUMPER_PROFILER_H
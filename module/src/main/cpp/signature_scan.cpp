@@ -0,0 +1,315 @@
+//
+// Masked byte-pattern search over the loaded segments of a library.
+//
+
+#include "signature_scan.h"
+#include <link.h>
+#include <algorithm>
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+// SIGNATURE_SCAN_SCALAR keeps only the byte loop: the baseline of the host benchmark.
+#if defined(__SSE2__) && !defined(SIGNATURE_SCAN_SCALAR)
+#define SIGNATURE_SCAN_SSE2
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) && !defined(SIGNATURE_SCAN_SCALAR)
+#define SIGNATURE_SCAN_NEON
+#include <arm_neon.h>
+#endif
+#include "log.h"
+#include "memory_io.h"
+#include "stats.h"
+
+// Every batch goes over the same chunk while it is still in L2.
+static constexpr size_t kSignatureChunk = 256 * 1024;
+
+// Rough rank of how often a byte shows up in code and data; anchors prefer the lowest.
+static int byte_rank(uint8_t byte) {
+    if (byte == 0x00 || byte == 0xff) {
+        return 2;
+    }
+    // Immediates and the opcode bytes that dominate arm64/arm/x86 code.
+    static const uint8_t common[] = {0x01, 0x02, 0x03, 0x04, 0x08, 0x10, 0x20, 0x40, 0x80, 0x48, 0x89, 0x8b,
+                                     0x91, 0x94, 0x97, 0xa9, 0xaa, 0xb9, 0xe1, 0xe5, 0xe8, 0xf9};
+    return memchr(common, byte, sizeof(common)) ? 1 : 0;
+}
+
+static int hex_value(char c) {
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    }
+    c = (char) (c | 0x20);
+    return c >= 'a' && c <= 'f' ? c - 'a' + 10 : -1;
+}
+
+bool SignatureSet::add(const char *name, const char *pattern) {
+    Signature signature;
+    signature.name = name;
+    for (auto p = pattern; *p;) {
+        if (*p == ' ' || *p == '\t') {
+            p++;
+            continue;
+        }
+        if (p[0] == '?') {
+            p += p[1] == '?' ? 2 : 1;
+            signature.bytes.push_back(0);
+            signature.mask.push_back(0);
+        } else {
+            int high = hex_value(p[0]), low = high < 0 ? -1 : hex_value(p[1]);
+            if (low < 0) {
+                return false;
+            }
+            p += 2;
+            signature.bytes.push_back((uint8_t) (high << 4 | low));
+            signature.mask.push_back(0xff);
+        }
+        if (*p && *p != ' ' && *p != '\t') {
+            return false;
+        }
+    }
+    // The rarest fixed byte is the anchor, the next rarest the first check after an anchor hit.
+    int best_rank = 3, check_rank = 3;
+    size_t check = 0;
+    for (size_t i = 0; i < signature.bytes.size(); ++i) {
+        if (!signature.mask[i]) {
+            continue;
+        }
+        auto rank = byte_rank(signature.bytes[i]);
+        if (rank < best_rank) {
+            check = best_rank < 3 ? signature.anchor : i;
+            check_rank = best_rank;
+            best_rank = rank;
+            signature.anchor = i;
+        } else if (rank < check_rank) {
+            check_rank = rank;
+            check = i;
+        }
+    }
+    // Nothing fixed to anchor on: it would match everywhere.
+    if (best_rank == 3) {
+        return false;
+    }
+    auto anchor_byte = signature.bytes[signature.anchor];
+    if (by_anchor[anchor_byte].empty()) {
+        if (batches.empty() || batches.back().count == kSignatureBatch) {
+            batches.emplace_back();
+        }
+        auto &batch = batches.back();
+        batch.anchors[batch.count++] = anchor_byte;
+    }
+    by_anchor[anchor_byte].push_back({(uint32_t) signatures.size(), (int32_t) check - (int32_t) signature.anchor,
+                                      signature.bytes[check]});
+    signatures.push_back(std::move(signature));
+    return true;
+}
+
+void SignatureSet::compile(const char *rules) {
+    auto line_start = rules;
+    while (*line_start) {
+        auto line_end = strchrnul(line_start, '\n');
+        std::string line(line_start, line_end);
+        line_start = *line_end ? line_end + 1 : line_end;
+        if (line.empty()) {
+            continue;
+        }
+        auto eq = line.find('=');
+        if (eq == std::string::npos || eq == 0) {
+            LOGW("signature: invalid line %s", line.c_str());
+            continue;
+        }
+        auto name = line.substr(0, line.find_last_not_of(" \t", eq - 1) + 1);
+        if (!add(name.c_str(), line.c_str() + eq + 1)) {
+            LOGW("signature: invalid pattern for %s", name.c_str());
+        }
+    }
+}
+
+void SignatureSet::match_at(const uint8_t *data, size_t size, size_t position, uintptr_t offset) {
+    for (auto &entry: by_anchor[data[position]]) {
+        auto check = (intptr_t) position + entry.check_delta;
+        if (check < 0 || (size_t) check >= size || data[check] != entry.check_byte) {
+            continue;
+        }
+        auto &signature = signatures[entry.signature];
+        if (position < signature.anchor || position - signature.anchor + signature.bytes.size() > size) {
+            continue;
+        }
+        auto start = data + position - signature.anchor;
+        bool match = true;
+        for (size_t i = 0; i < signature.bytes.size() && match; ++i) {
+            match = (start[i] & signature.mask[i]) == signature.bytes[i];
+        }
+        if (!match) {
+            continue;
+        }
+        if (signature.matches.size() < kSignatureMaxMatches) {
+            signature.matches.push_back(offset + (start - data));
+        }
+        signature.match_count++;
+    }
+}
+
+// Reports the anchor hits of one batch in [begin, end); size bounds the pattern comparisons.
+void SignatureSet::scan_batch(const Batch &batch, const uint8_t *data, size_t begin, size_t end, size_t size,
+                              uintptr_t offset) {
+    auto i = begin;
+#if defined(SIGNATURE_SCAN_SSE2)
+    __m128i needles[kSignatureBatch];
+    for (size_t k = 0; k < batch.count; ++k) {
+        needles[k] = _mm_set1_epi8((char) batch.anchors[k]);
+    }
+    for (; i + 16 <= end; i += 16) {
+        auto block = _mm_loadu_si128((const __m128i *) (data + i));
+        auto hits = _mm_cmpeq_epi8(block, needles[0]);
+        for (size_t k = 1; k < batch.count; ++k) {
+            hits = _mm_or_si128(hits, _mm_cmpeq_epi8(block, needles[k]));
+        }
+        for (auto mask = (uint32_t) _mm_movemask_epi8(hits); mask; mask &= mask - 1) {
+            match_at(data, size, i + __builtin_ctz(mask), offset);
+        }
+    }
+#elif defined(SIGNATURE_SCAN_NEON)
+    uint8x16_t needles[kSignatureBatch];
+    for (size_t k = 0; k < batch.count; ++k) {
+        needles[k] = vdupq_n_u8(batch.anchors[k]);
+    }
+    for (; i + 16 <= end; i += 16) {
+        auto block = vld1q_u8(data + i);
+        auto hits = vceqq_u8(block, needles[0]);
+        for (size_t k = 1; k < batch.count; ++k) {
+            hits = vorrq_u8(hits, vceqq_u8(block, needles[k]));
+        }
+#if defined(__aarch64__)
+        // Narrowing shift: 4 bits per byte, the movemask NEON lacks. One bit per nibble is kept.
+        auto mask = vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(hits), 4)), 0) &
+                    0x8888888888888888ull;
+        for (; mask; mask &= mask - 1) {
+            match_at(data, size, i + __builtin_ctzll(mask) / 4, offset);
+        }
+#else
+        auto folded = vorr_u32(vget_low_u32(vreinterpretq_u32_u8(hits)), vget_high_u32(vreinterpretq_u32_u8(hits)));
+        if (vget_lane_u32(folded, 0) | vget_lane_u32(folded, 1)) {
+            for (size_t j = i; j < i + 16; ++j) {
+                if (std::find(batch.anchors, batch.anchors + batch.count, data[j]) != batch.anchors + batch.count) {
+                    match_at(data, size, j, offset);
+                }
+            }
+        }
+#endif
+    }
+#endif
+    for (; i < end; ++i) {
+        if (std::find(batch.anchors, batch.anchors + batch.count, data[i]) != batch.anchors + batch.count) {
+            match_at(data, size, i, offset);
+        }
+    }
+}
+
+void SignatureSet::scan(const uint8_t *data, size_t size, uintptr_t offset) {
+    auto start = std::chrono::steady_clock::now();
+    for (size_t begin = 0; begin < size; begin += kSignatureChunk) {
+        auto end = std::min(size, begin + kSignatureChunk);
+        for (auto &batch: batches) {
+            scan_batch(batch, data, begin, end, size, offset);
+        }
+    }
+    scanned_bytes += size;
+    scan_us += std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - start).count();
+}
+
+bool SignatureSet::scan_module(const void *address) {
+    uintptr_t bias = 0;
+    std::vector<std::pair<uintptr_t, uintptr_t>> segments;
+    memory_find_module((uintptr_t) address, nullptr, [&](const dl_phdr_info *info) {
+        bias = info->dlpi_addr;
+        for (int i = 0; i < info->dlpi_phnum; ++i) {
+            auto &phdr = info->dlpi_phdr[i];
+            if (phdr.p_type == PT_LOAD && (phdr.p_flags & PF_R)) {
+                segments.emplace_back(bias + phdr.p_vaddr, bias + phdr.p_vaddr + phdr.p_filesz);
+            }
+        }
+    });
+    if (segments.empty()) {
+        return false;
+    }
+    // Packers may revoke read access to parts of a segment: only scan what the maps say is readable,
+    // joining adjacent mappings so patterns can cross them.
+    std::vector<MemoryMapping> mappings;
+    memory_mappings(&mappings);
+    for (auto [begin, end]: segments) {
+        uintptr_t run_start = 0, run_end = 0;
+        for (auto &mapping: mappings) {
+            auto start = std::max(begin, mapping.start), stop = std::min(end, mapping.end);
+            if (start >= stop || mapping.perms[0] != 'r') {
+                continue;
+            }
+            if (start != run_end) {
+                if (run_end) {
+                    scan((const uint8_t *) run_start, run_end - run_start, run_start - bias);
+                }
+                run_start = start;
+            }
+            run_end = stop;
+        }
+        if (run_end) {
+            scan((const uint8_t *) run_start, run_end - run_start, run_start - bias);
+        }
+    }
+    return true;
+}
+
+void SignatureSet::record_stats() const {
+    uint64_t matched = 0;
+    for (auto &signature: signatures) {
+        matched += signature.match_count > 0;
+    }
+    auto mb = (double) scanned_bytes / (1024 * 1024);
+    auto seconds = (double) scan_us / 1e6;
+    stats_record("signature_patterns", "%zu", signatures.size());
+    stats_record("signature_batches", "%zu", batches.size());
+    stats_record("signature_matched", "%llu", (unsigned long long) matched);
+    stats_record("signature_scan_mb", "%.1f", mb);
+    stats_record("signature_scan_ms", "%.1f", seconds * 1000);
+    if (seconds > 0) {
+        stats_record("signature_scan_mb_per_sec", "%.0f", mb / seconds);
+        // Pattern-megabytes per second: what one pass per pattern would have needed to match it.
+        stats_record("signature_scan_pattern_mb_per_sec", "%.0f", mb * signatures.size() / seconds);
+    }
+}
+
+bool signature_dump(const void *il2cpp_address, const char *rules, const char *game_data_dir) {
+    SignatureSet set;
+    set.compile(rules);
+    if (set.empty()) {
+        return false;
+    }
+    if (!set.scan_module(il2cpp_address)) {
+        LOGE("signature: libil2cpp.so not found among the loaded modules");
+        return false;
+    }
+    auto path = std::string(game_data_dir).append("/files/signatures.txt");
+    auto file = fopen(path.c_str(), "we");
+    if (!file) {
+        LOGE("Unable to open %s", path.c_str());
+        return false;
+    }
+    for (size_t i = 0; i < set.size(); ++i) {
+        if (!set.match_count(i)) {
+            fprintf(file, "%s not found\n", set.name(i).c_str());
+            continue;
+        }
+        for (auto offset: set.matches(i)) {
+            fprintf(file, "%s 0x%" PRIxPTR "\n", set.name(i).c_str(), offset);
+        }
+        if (set.match_count(i) > set.matches(i).size()) {
+            fprintf(file, "# %s: %" PRIu64 " more matches\n", set.name(i).c_str(),
+                    set.match_count(i) - set.matches(i).size());
+        }
+    }
+    fclose(file);
+    LOGI("signatures written to %s", path.c_str());
+    set.record_stats();
+    return true;
+}
@@ -0,0 +1,90 @@
+//
+// Masked byte-pattern search over the loaded segments of a library, for internals il2cpp does not
+// export (CodeRegistration, MetadataRegistration, string literal tables...).
+//
+// Patterns are IDA-style: hex bytes separated by spaces, "?" or "??" for any byte, e.g.
+// "48 8B 05 ?? ?? ?? ?? E8". Each pattern is anchored on its least common fixed byte; anchors are
+// searched with SSE2/NEON up to kSignatureBatch at a time, and only anchor hits are compared
+// against the full pattern, so many patterns cost about one pass per batch over the segments.
+//
+
+#ifndef ZYGISK_IL2CPPDUMPER_SIGNATURE_SCAN_H
+#define ZYGISK_IL2CPPDUMPER_SIGNATURE_SCAN_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+// Distinct anchor bytes compared per vector pass.
+static constexpr size_t kSignatureBatch = 8;
+// Matches kept per pattern; further ones are only counted.
+static constexpr size_t kSignatureMaxMatches = 16;
+
+class SignatureSet {
+public:
+    // Parses "name=pattern" lines; invalid ones are logged and skipped.
+    void compile(const char *rules);
+
+    bool add(const char *name, const char *pattern);
+
+    bool empty() const { return signatures.empty(); }
+
+    size_t size() const { return signatures.size(); }
+
+    const std::string &name(size_t index) const { return signatures[index].name; }
+
+    // Offsets of the first kSignatureMaxMatches matches, relative to the scanned module's base.
+    const std::vector<uintptr_t> &matches(size_t index) const { return signatures[index].matches; }
+
+    uint64_t match_count(size_t index) const { return signatures[index].match_count; }
+
+    // Searches size bytes at data, which start at offset from the module base.
+    void scan(const uint8_t *data, size_t size, uintptr_t offset);
+
+    // Searches the readable parts of the PT_LOAD segments of the module containing address.
+    // Returns false if no loaded module contains it.
+    bool scan_module(const void *address);
+
+    void record_stats() const;
+
+private:
+    struct Signature {
+        std::string name;
+        std::vector<uint8_t> bytes; // already masked
+        std::vector<uint8_t> mask;  // 0xff for fixed bytes, 0 for wildcards
+        size_t anchor = 0;          // index of the byte the vector pass looks for
+        std::vector<uintptr_t> matches;
+        uint64_t match_count = 0;
+    };
+
+    // Hits on an anchor byte are first checked against a second fixed byte of the pattern.
+    struct AnchorEntry {
+        uint32_t signature;
+        int32_t check_delta; // position of the second byte relative to the anchor
+        uint8_t check_byte;
+    };
+
+    struct Batch {
+        uint8_t anchors[kSignatureBatch];
+        size_t count = 0;
+    };
+
+    void match_at(const uint8_t *data, size_t size, size_t position, uintptr_t offset);
+
+    void scan_batch(const Batch &batch, const uint8_t *data, size_t begin, size_t end, size_t size,
+                    uintptr_t offset);
+
+    std::vector<Signature> signatures;
+    // Signatures by anchor byte; each anchor byte belongs to exactly one batch.
+    std::vector<AnchorEntry> by_anchor[256];
+    std::vector<Batch> batches;
+    uint64_t scanned_bytes = 0;
+    int64_t scan_us = 0;
+};
+
+// Scans libil2cpp.so (il2cpp_address is any address inside it) for the signatures in rules and
+// writes "name 0x<offset>" lines to <game_data_dir>/files/signatures.txt.
+bool signature_dump(const void *il2cpp_address, const char *rules, const char *game_data_dir);
+
+#endif //ZYGISK_IL2CPPDUMPER_SIGNATURE_SCAN_H
@@ -0,0 +1,58 @@
+//
+// Run statistics: each value is logged when recorded and appended to
+// <game_data_dir>/files/dump_stats.txt on flush.
+//
+
+#include "stats.h"
+#include <unistd.h>
+#include <cstdarg>
+#include <cstdio>
+#include <ctime>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+#include "log.h"
+
+#if defined(__aarch64__)
+#define STATS_ABI "arm64-v8a"
+#elif defined(__arm__)
+#define STATS_ABI "armeabi-v7a"
+#elif defined(__x86_64__)
+#define STATS_ABI "x86_64"
+#elif defined(__i386__)
+#define STATS_ABI "x86"
+#endif
+
+static std::mutex stats_mutex;
+static std::vector<std::pair<std::string, std::string>> stats_values;
+
+void stats_record(const char *key, const char *fmt, ...) {
+    char value[256];
+    va_list args;
+    va_start(args, fmt);
+    vsnprintf(value, sizeof(value), fmt, args);
+    va_end(args);
+    LOGI("stats: %s=%s", key, value);
+    std::lock_guard<std::mutex> lock(stats_mutex);
+    stats_values.emplace_back(key, value);
+}
+
+void stats_flush(const char *game_data_dir) {
+    std::lock_guard<std::mutex> lock(stats_mutex);
+    if (stats_values.empty()) {
+        return;
+    }
+    auto path = std::string(game_data_dir).append("/files/dump_stats.txt");
+    auto file = fopen(path.c_str(), "a");
+    if (!file) {
+        LOGW("Unable to open %s", path.c_str());
+        return;
+    }
+    fprintf(file, "# time=%ld pid=%d abi=%s\n", (long) time(nullptr), getpid(), STATS_ABI);
+    for (auto &[key, value]: stats_values) {
+        fprintf(file, "%s=%s\n", key.c_str(), value.c_str());
+    }
+    fclose(file);
+    stats_values.clear();
+}
@@ -0,0 +1,13 @@
+//
+// Run statistics: each value is logged when recorded and appended to
+// <game_data_dir>/files/dump_stats.txt on flush.
+//
+
+#ifndef ZYGISK_IL2CPPDUMPER_STATS_H
+#define ZYGISK_IL2CPPDUMPER_STATS_H
+
+void stats_record(const char *key, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+
+void stats_flush(const char *game_data_dir);
+
+#endif //ZYGISK_IL2CPPDUMPER_STATS_H
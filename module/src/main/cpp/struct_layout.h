@@ -0,0 +1,150 @@
+//
+// Layouts of il2cpp's MethodInfo, ParameterInfo and FieldInfo across runtime versions, so members
+// can be read straight from memory instead of through one il2cpp_* call per attribute.
+//
+// Only the leading fields the dumper reads are modelled. The layout in use is chosen once per dump
+// by comparing each candidate against the API on a sample of real members (il2cpp_dump.cpp); when
+// none matches, every read keeps going through the API.
+//
+// il2cpp-class.h has no include guard, so this header expects it to be included first.
+//
+
+#ifndef ZYGISK_IL2CPPDUMPER_STRUCT_LAYOUT_H
+#define ZYGISK_IL2CPPDUMPER_STRUCT_LAYOUT_H
+
+#include <stdint.h>
+
+enum class StructLayout : uint8_t {
+    api,   // no direct reads
+    v24_0, // Unity 2017.x - 2018.2: members still carry a customAttributeIndex
+    v24_1, // Unity 2018.3 - 2021.1
+    v29,   // Unity 2021.2+: virtualMethodPointer, parameters are bare Il2CppType pointers
+};
+
+inline const char *struct_layout_name(StructLayout layout) {
+    switch (layout) {
+        case StructLayout::v24_0:
+            return "v24.0";
+        case StructLayout::v24_1:
+            return "v24.1";
+        case StructLayout::v29:
+            return "v29";
+        default:
+            return "api";
+    }
+}
+
+template<StructLayout L>
+struct Il2CppLayout;
+
+template<>
+struct Il2CppLayout<StructLayout::v24_0> {
+    struct ParameterInfo {
+        const char *name;
+        int32_t position;
+        uint32_t token;
+        int32_t customAttributeIndex;
+        const Il2CppType *parameter_type;
+    };
+
+    struct MethodInfo {
+        Il2CppMethodPointer methodPointer;
+        void *invoker_method;
+        const char *name;
+        Il2CppClass *klass;
+        const Il2CppType *return_type;
+        const ParameterInfo *parameters;
+        const void *rgctx_data;
+        const void *generic;
+        int32_t customAttributeIndex;
+        uint32_t token;
+        uint16_t flags;
+        uint16_t iflags;
+        uint16_t slot;
+        uint8_t parameters_count;
+    };
+
+    struct FieldInfo {
+        const char *name;
+        const Il2CppType *type;
+        Il2CppClass *parent;
+        int32_t offset;
+    };
+
+    static const Il2CppType *param_type(const MethodInfo *method, uint32_t index) {
+        return method->parameters[index].parameter_type;
+    }
+
+    static const char *param_name(const MethodInfo *method, uint32_t index) {
+        return method->parameters[index].name;
+    }
+};
+
+template<>
+struct Il2CppLayout<StructLayout::v24_1> {
+    struct ParameterInfo {
+        const char *name;
+        int32_t position;
+        uint32_t token;
+        const Il2CppType *parameter_type;
+    };
+
+    struct MethodInfo {
+        Il2CppMethodPointer methodPointer;
+        void *invoker_method;
+        const char *name;
+        Il2CppClass *klass;
+        const Il2CppType *return_type;
+        const ParameterInfo *parameters;
+        const void *rgctx_data;
+        const void *generic;
+        uint32_t token;
+        uint16_t flags;
+        uint16_t iflags;
+        uint16_t slot;
+        uint8_t parameters_count;
+    };
+
+    using FieldInfo = Il2CppLayout<StructLayout::v24_0>::FieldInfo;
+
+    static const Il2CppType *param_type(const MethodInfo *method, uint32_t index) {
+        return method->parameters[index].parameter_type;
+    }
+
+    static const char *param_name(const MethodInfo *method, uint32_t index) {
+        return method->parameters[index].name;
+    }
+};
+
+template<>
+struct Il2CppLayout<StructLayout::v29> {
+    struct MethodInfo {
+        Il2CppMethodPointer methodPointer;
+        Il2CppMethodPointer virtualMethodPointer;
+        void *invoker_method;
+        const char *name;
+        Il2CppClass *klass;
+        const Il2CppType *return_type;
+        const Il2CppType **parameters;
+        const void *rgctx_data;
+        const void *generic;
+        uint32_t token;
+        uint16_t flags;
+        uint16_t iflags;
+        uint16_t slot;
+        uint8_t parameters_count;
+    };
+
+    using FieldInfo = Il2CppLayout<StructLayout::v24_0>::FieldInfo;
+
+    static const Il2CppType *param_type(const MethodInfo *method, uint32_t index) {
+        return method->parameters[index];
+    }
+
+    // Parameter names moved to the metadata: the API is the only way to them.
+    static const char *param_name(const MethodInfo *, uint32_t) {
+        return nullptr;
+    }
+};
+
+#endif //ZYGISK_IL2CPPDUMPER_STRUCT_LAYOUT_H
@@ -0,0 +1,263 @@
+//
+// Lock-free address to method lookups over a table built once after the dump.
+//
+
+#include "symbolizer.h"
+#include <link.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include "log.h"
+#include "stats.h"
+#include "xdl.h"
+
+// Lookups timed after install, for the stats.
+static constexpr size_t kBenchmarkLookups = 100000;
+
+struct SymbolMethod {
+    uint32_t size;    // 0 when unknown: the body then runs up to the next one
+    uint32_t image;   // offsets into SymbolTable::strings
+    uint32_t type;
+    uint32_t method;
+    uint32_t aliases;
+};
+
+struct SymbolModule {
+    uintptr_t start; // lowest PT_LOAD address
+    uintptr_t end;
+    uintptr_t bias;
+    uint32_t path;
+};
+
+struct SymbolTable {
+    std::vector<uintptr_t> starts;     // one per distinct body, ascending
+    std::vector<SymbolMethod> methods; // parallel to starts
+    std::vector<uintptr_t> module_starts;
+    std::vector<SymbolModule> modules; // parallel to module_starts
+    std::string strings;
+};
+
+// Set once and never freed: a reader in a signal handler may hold it at any time.
+static std::atomic<const SymbolTable *> published{nullptr};
+
+static uint32_t add_string(SymbolTable *table, const std::string &value) {
+    auto offset = (uint32_t) table->strings.size();
+    table->strings.append(value).push_back('\0');
+    return offset;
+}
+
+static void snapshot_modules(SymbolTable *table) {
+    dl_iterate_phdr([](dl_phdr_info *info, size_t, void *data) {
+        auto table = (SymbolTable *) data;
+        SymbolModule module{UINTPTR_MAX, 0, info->dlpi_addr, 0};
+        for (int i = 0; i < info->dlpi_phnum; ++i) {
+            auto &phdr = info->dlpi_phdr[i];
+            if (phdr.p_type == PT_LOAD) {
+                module.start = std::min<uintptr_t>(module.start, info->dlpi_addr + phdr.p_vaddr);
+                module.end = std::max<uintptr_t>(module.end, info->dlpi_addr + phdr.p_vaddr + phdr.p_memsz);
+            }
+        }
+        if (module.start < module.end) {
+            module.path = add_string(table, info->dlpi_name ? info->dlpi_name : "");
+            table->modules.push_back(module);
+        }
+        return 0;
+    }, table);
+    std::sort(table->modules.begin(), table->modules.end(),
+              [](const SymbolModule &a, const SymbolModule &b) { return a.start < b.start; });
+    for (auto &module: table->modules) {
+        table->module_starts.push_back(module.start);
+    }
+}
+
+// Index of the last element of starts at or below address, or -1.
+static ptrdiff_t find_floor(const std::vector<uintptr_t> &starts, uintptr_t address) {
+    return std::upper_bound(starts.begin(), starts.end(), address) - starts.begin() - 1;
+}
+
+static void record_lookup_time(const SymbolTable &table) {
+    if (table.starts.empty()) {
+        return;
+    }
+    SymbolizedFrame frame{};
+    uint32_t found = 0;
+    auto stride = std::max<size_t>(1, table.starts.size() / kBenchmarkLookups);
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < kBenchmarkLookups; ++i) {
+        found += symbolizer_lookup(table.starts[(i * stride) % table.starts.size()] + 1, &frame);
+    }
+    auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - start).count();
+    stats_record("symbolizer_lookup_ns", "%.1f", (double) elapsed / kBenchmarkLookups);
+    if (found != kBenchmarkLookups) {
+        LOGW("symbolizer: %zu of %zu method addresses did not resolve", kBenchmarkLookups - found,
+             kBenchmarkLookups);
+    }
+}
+
+void symbolizer_install(const MethodIndex &index, const CodeInfo &code, const std::vector<std::string> &image_names) {
+    if (published.load(std::memory_order_acquire)) {
+        LOGW("symbolizer: already installed");
+        return;
+    }
+    auto start = std::chrono::steady_clock::now();
+    auto table = new SymbolTable;
+    table->strings.push_back('\0');
+    std::vector<uint32_t> image_offsets(image_names.size(), UINT32_MAX);
+    std::vector<uint32_t> type_offsets;
+    auto &entries = index.entries();
+    for (size_t i = 0; i < entries.size();) {
+        // The index is sorted by RVA, then by type and method: the first name of a body stays primary.
+        auto &entry = entries[i];
+        auto group_end = i + 1;
+        while (group_end < entries.size() && entries[group_end].rva == entry.rva) {
+            group_end++;
+        }
+        auto &type = index.type(entry.type_id);
+        if (entry.type_id >= type_offsets.size()) {
+            type_offsets.resize(entry.type_id + 1, UINT32_MAX);
+        }
+        if (type_offsets[entry.type_id] == UINT32_MAX) {
+            type_offsets[entry.type_id] = add_string(table, type.name);
+        }
+        uint32_t image = 0;
+        if (type.image_index < image_names.size()) {
+            if (image_offsets[type.image_index] == UINT32_MAX) {
+                image_offsets[type.image_index] = add_string(table, image_names[type.image_index]);
+            }
+            image = image_offsets[type.image_index];
+        }
+        table->starts.push_back(code.base + entry.rva);
+        table->methods.push_back({entry.size, image, type_offsets[entry.type_id],
+                                  add_string(table, type.methods[entry.method_id]),
+                                  (uint32_t) (group_end - i - 1)});
+        i = group_end;
+    }
+    snapshot_modules(table);
+    table->strings.shrink_to_fit();
+    auto bytes = table->starts.size() * (sizeof(uintptr_t) + sizeof(SymbolMethod)) +
+                 table->modules.size() * (sizeof(uintptr_t) + sizeof(SymbolModule)) + table->strings.size();
+    const SymbolTable *expected = nullptr;
+    if (!published.compare_exchange_strong(expected, table, std::memory_order_release)) {
+        delete table;
+        return;
+    }
+    auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now() - start).count();
+    LOGI("symbolizer: %zu method bodies, %zu libraries", table->starts.size(), table->modules.size());
+    stats_record("symbolizer_methods", "%zu", table->starts.size());
+    stats_record("symbolizer_libraries", "%zu", table->modules.size());
+    stats_record("symbolizer_bytes", "%zu", bytes);
+    stats_record("symbolizer_build_ms", "%lld", (long long) elapsed);
+    record_lookup_time(*table);
+}
+
+bool symbolizer_lookup(uintptr_t address, SymbolizedFrame *frame) {
+    auto table = published.load(std::memory_order_acquire);
+    if (!table) {
+        return false;
+    }
+    auto i = find_floor(table->starts, address);
+    if (i >= 0) {
+        auto &method = table->methods[i];
+        auto start = table->starts[i];
+        if (method.size ? address - start < method.size : (size_t) i + 1 < table->starts.size()) {
+            *frame = {start, address - start, &table->strings[method.image], &table->strings[method.type],
+                      &table->strings[method.method], method.aliases, true};
+            return true;
+        }
+    }
+    auto m = find_floor(table->module_starts, address);
+    if (m >= 0 && address < table->modules[m].end) {
+        auto &module = table->modules[m];
+        *frame = {module.bias, address - module.bias, &table->strings[module.path], nullptr, nullptr, 0, false};
+        return true;
+    }
+    return false;
+}
+
+// snprintf is not async-signal-safe: the formatting below only copies bytes.
+namespace {
+struct Writer {
+    char *buffer;
+    size_t size;
+    size_t length = 0;
+
+    void put(const char *text) {
+        for (; text && *text; ++text) {
+            if (length + 1 < size) {
+                buffer[length++] = *text;
+            }
+        }
+    }
+
+    void hex(uintptr_t value) {
+        char digits[2 + sizeof(value) * 2 + 1];
+        auto p = digits + sizeof(digits) - 1;
+        *p = '\0';
+        do {
+            *--p = "0123456789abcdef"[value & 0xf];
+            value >>= 4;
+        } while (value);
+        *--p = 'x';
+        *--p = '0';
+        put(p);
+    }
+
+    size_t finish() {
+        if (size) {
+            buffer[length] = '\0';
+        }
+        return length;
+    }
+};
+}
+
+size_t symbolizer_format(const SymbolizedFrame &frame, char *buffer, size_t size) {
+    Writer out{buffer, size};
+    if (frame.managed) {
+        out.put(frame.type);
+        out.put("::");
+        out.put(frame.method);
+        out.put("+");
+        out.hex(frame.offset);
+        out.put(" (");
+        out.put(frame.image);
+        out.put(")");
+    } else {
+        out.put(frame.image);
+        out.put("+");
+        out.hex(frame.offset);
+    }
+    return out.finish();
+}
+
+size_t symbolizer_describe(uintptr_t address, char *buffer, size_t size, void **xdl_cache) {
+    SymbolizedFrame frame{};
+    auto found = symbolizer_lookup(address, &frame);
+    if (found && frame.managed) {
+        return symbolizer_format(frame, buffer, size);
+    }
+    xdl_info_t info{};
+    if (!xdl_addr((void *) address, &info, xdl_cache)) {
+        return found ? symbolizer_format(frame, buffer, size) : 0;
+    }
+    Writer out{buffer, size};
+    out.put(info.dli_fname);
+    if (info.dli_sname) {
+        out.put(" (");
+        out.put(info.dli_sname);
+        out.put("+");
+        out.hex(address - (uintptr_t) info.dli_saddr);
+        out.put(")");
+    } else {
+        out.put("+");
+        out.hex(address - (uintptr_t) info.dli_fbase);
+    }
+    return out.finish();
+}
+
+size_t il2cpp_dumper_symbolize(uintptr_t address, char *buffer, size_t size) {
+    SymbolizedFrame frame{};
+    return symbolizer_lookup(address, &frame) ? symbolizer_format(frame, buffer, size) : 0;
+}
@@ -0,0 +1,55 @@
+//
+// In-process symbolizer: maps a code address to the managed method compiled there or, outside
+// il2cpp code, to the native library around it.
+//
+// The table is built once after the dump from the MethodIndex: a sorted array of method start
+// addresses, searched by binary search, next to a parallel array with each body's size and names.
+// It is published with one atomic store and never modified or freed afterwards, so lookups take no
+// lock, allocate nothing and are async-signal-safe. The libraries are a snapshot taken at the same
+// time; symbolizer_describe asks xdl_addr about the rest, and is not signal-safe.
+//
+// Other libraries in the game process (crash and ANR handlers) reach the table through the exported
+// il2cpp_dumper_symbolize.
+//
+
+#ifndef ZYGISK_IL2CPPDUMPER_SYMBOLIZER_H
+#define ZYGISK_IL2CPPDUMPER_SYMBOLIZER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include "dump_record.h"
+#include "method_index.h"
+
+struct SymbolizedFrame {
+    uintptr_t start;    // first byte of the method, or load bias of the library
+    uintptr_t offset;   // address - start
+    const char *image;  // assembly for managed frames, library path otherwise
+    const char *type;   // declaring type; nullptr for native frames
+    const char *method; // nullptr for native frames
+    uint32_t aliases;   // other methods compiled to the same body
+    bool managed;
+};
+
+// Builds the table from a built index and publishes it. Only the first call installs a table.
+void symbolizer_install(const MethodIndex &index, const CodeInfo &code, const std::vector<std::string> &image_names);
+
+// Async-signal-safe. Returns false before install or for addresses outside every known library.
+bool symbolizer_lookup(uintptr_t address, SymbolizedFrame *frame);
+
+// "Namespace.Type::Method+0x1c (Assembly-CSharp.dll)" or "/path/libfoo.so+0x1234", truncated to
+// size and always terminated. Async-signal-safe. Returns the length written.
+size_t symbolizer_format(const SymbolizedFrame &frame, char *buffer, size_t size);
+
+// symbolizer_lookup and symbolizer_format, then xdl_addr for native symbol names and for libraries
+// loaded after install: "/path/libfoo.so (symbol+0x10)". xdl_cache is xdl_addr's cache, reused
+// across calls and released with xdl_addr_clean. Not signal-safe.
+size_t symbolizer_describe(uintptr_t address, char *buffer, size_t size, void **xdl_cache);
+
+// C entry point for other libraries, found with dlsym. Same as symbolizer_lookup + symbolizer_format:
+// returns 0 when address is unknown.
+extern "C" __attribute__((visibility("default")))
+size_t il2cpp_dumper_symbolize(uintptr_t address, char *buffer, size_t size);
+
+#endif //ZYGISK_IL2CPPDUMPER_SYMBOLIZER_H
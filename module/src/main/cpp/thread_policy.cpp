@@ -0,0 +1,132 @@
+//
+// Scheduling of the dump thread: nice value, SCHED_BATCH/SCHED_IDLE, affinity to the little cores
+// and I/O priority.
+//
+
+#include "thread_policy.h"
+#include <sched.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#include "log.h"
+#include "stats.h"
+
+// linux/ioprio.h is not part of the NDK sysroot.
+#define IOPRIO_CLASS_SHIFT 13
+#define IOPRIO_CLASS_BE 2
+#define IOPRIO_WHO_PROCESS 1
+
+static long read_cpu_value(int cpu, const char *name) {
+    char path[128];
+    snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/%s", cpu, name);
+    auto file = fopen(path, "r");
+    if (!file) {
+        return -1;
+    }
+    long value = -1;
+    if (fscanf(file, "%ld", &value) != 1) {
+        value = -1;
+    }
+    fclose(file);
+    return value;
+}
+
+// CPUs with the lowest cpu_capacity (or, on kernels without it, the lowest cpuinfo_max_freq).
+// Empty when every core is the same.
+static std::vector<int> little_cores() {
+    std::vector<int> cores;
+    auto count = (int) sysconf(_SC_NPROCESSORS_CONF);
+    for (auto attribute: {"cpu_capacity", "cpufreq/cpuinfo_max_freq"}) {
+        std::vector<long> values;
+        long min = LONG_MAX, max = -1;
+        for (int cpu = 0; cpu < count; ++cpu) {
+            auto value = read_cpu_value(cpu, attribute);
+            values.push_back(value);
+            if (value > 0) {
+                min = std::min(min, value);
+                max = std::max(max, value);
+            }
+        }
+        if (max <= 0 || min == max) {
+            continue;
+        }
+        for (int cpu = 0; cpu < count; ++cpu) {
+            if (values[cpu] == min) {
+                cores.push_back(cpu);
+            }
+        }
+        break;
+    }
+    return cores;
+}
+
+bool thread_policy_set_io_priority(int level) {
+    if (level < 0) {
+        return false;
+    }
+    auto ioprio = IOPRIO_CLASS_BE << IOPRIO_CLASS_SHIFT | std::min(level, 7);
+    if (syscall(__NR_ioprio_set, IOPRIO_WHO_PROCESS, gettid(), ioprio) != 0) {
+        LOGW("ioprio_set failed: %s", strerror(errno));
+        return false;
+    }
+    return true;
+}
+
+void thread_policy_apply(const DumperConfig &config) {
+    std::string applied;
+    char part[64];
+
+    if (config.dump_sched == SCHED_BATCH || config.dump_sched == SCHED_IDLE) {
+        sched_param param{};
+        // Applies to the calling thread only: on Linux, pid 0 is the caller's tid.
+        if (sched_setscheduler(0, config.dump_sched, &param) == 0) {
+            applied += config.dump_sched == SCHED_IDLE ? "policy=idle " : "policy=batch ";
+        } else {
+            LOGW("sched_setscheduler(%d) failed: %s", config.dump_sched, strerror(errno));
+        }
+    }
+    // SCHED_IDLE ignores the nice value.
+    if (config.dump_sched != SCHED_IDLE) {
+        if (setpriority(PRIO_PROCESS, gettid(), config.dump_nice) == 0) {
+            snprintf(part, sizeof(part), "nice=%d ", config.dump_nice);
+            applied += part;
+        } else {
+            LOGW("setpriority(%d) failed: %s", config.dump_nice, strerror(errno));
+        }
+    }
+    if (config.little_cores) {
+        auto cores = little_cores();
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        for (auto cpu: cores) {
+            CPU_SET(cpu, &set);
+        }
+        if (!cores.empty() && sched_setaffinity(0, sizeof(set), &set) == 0) {
+            applied += "cpus=";
+            for (size_t i = 0; i < cores.size(); ++i) {
+                snprintf(part, sizeof(part), i ? ",%d" : "%d", cores[i]);
+                applied += part;
+            }
+            applied += " ";
+        } else if (cores.empty()) {
+            LOGI("No little cores found, affinity unchanged");
+        } else {
+            LOGW("sched_setaffinity failed: %s", strerror(errno));
+        }
+    }
+    if (thread_policy_set_io_priority(config.io_priority)) {
+        snprintf(part, sizeof(part), "ioprio=be/%d ", std::min(config.io_priority, 7));
+        applied += part;
+    }
+    if (!applied.empty()) {
+        applied.pop_back();
+    }
+    stats_record("dump_thread_policy", "%s", applied.empty() ? "default" : applied.c_str());
+}
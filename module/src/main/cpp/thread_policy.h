@@ -0,0 +1,17 @@
+//
+// Scheduling of the dump thread, so a dump does not steal frame time from the game: nice value,
+// SCHED_BATCH/SCHED_IDLE, affinity to the little cores and I/O priority, all from config.txt.
+//
+
+#ifndef ZYGISK_IL2CPPDUMPER_THREAD_POLICY_H
+#define ZYGISK_IL2CPPDUMPER_THREAD_POLICY_H
+
+#include "config.h"
+
+// Applies the configured policy to the calling thread and records what was applied in the stats.
+void thread_policy_apply(const DumperConfig &config);
+
+// Sets the best-effort I/O priority (0 highest .. 7 lowest) of the calling thread. -1 leaves it.
+bool thread_policy_set_io_priority(int level);
+
+#endif //ZYGISK_IL2CPPDUMPER_THREAD_POLICY_H
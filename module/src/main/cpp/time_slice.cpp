@@ -0,0 +1,69 @@
+//
+// Cooperative time slicing for the dump loop.
+//
+
+#include "time_slice.h"
+#include <sched.h>
+#include <ctime>
+#include <algorithm>
+#include "log.h"
+#include "stats.h"
+
+static int64_t clock_ns(clockid_t clock) {
+    timespec ts{};
+    clock_gettime(clock, &ts);
+    return (int64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+TimeSlicer::TimeSlicer(int32_t budget_us, int32_t pause_us)
+        : budget_ns(budget_us > 0 ? (int64_t) budget_us * 1000 : 0),
+          pause_ns(pause_us > 0 ? (int64_t) pause_us * 1000 : 0),
+          dump_start_ns(clock_ns(CLOCK_MONOTONIC)) {
+    start_slice();
+}
+
+void TimeSlicer::start_slice() {
+    slice_cpu_start_ns = clock_ns(CLOCK_THREAD_CPUTIME_ID);
+    slice_wall_start_ns = clock_ns(CLOCK_MONOTONIC);
+}
+
+void TimeSlicer::tick(const DumpCursor &cursor) {
+    if (!budget_ns) {
+        return;
+    }
+    auto cpu_ns = clock_ns(CLOCK_THREAD_CPUTIME_ID) - slice_cpu_start_ns;
+    if (cpu_ns < budget_ns) {
+        return;
+    }
+    auto now = clock_ns(CLOCK_MONOTONIC);
+    max_slice_cpu_ns = std::max(max_slice_cpu_ns, cpu_ns);
+    max_slice_wall_ns = std::max(max_slice_wall_ns, now - slice_wall_start_ns);
+    slices++;
+    if (pause_ns) {
+        timespec pause{(time_t) (pause_ns / 1000000000), (long) (pause_ns % 1000000000)};
+        nanosleep(&pause, nullptr);
+    } else {
+        sched_yield();
+    }
+    paused_ns += clock_ns(CLOCK_MONOTONIC) - now;
+    if (slices % 1000 == 0) {
+        LOGD("dump slice %u, resuming at image %u class %u", slices, cursor.image, cursor.klass);
+    }
+    start_slice();
+}
+
+void TimeSlicer::finish(uint32_t items) {
+    auto wall_ns = clock_ns(CLOCK_MONOTONIC) - dump_start_ns;
+    if (budget_ns) {
+        // The last, partial slice counts too.
+        auto now = clock_ns(CLOCK_MONOTONIC);
+        max_slice_cpu_ns = std::max(max_slice_cpu_ns, clock_ns(CLOCK_THREAD_CPUTIME_ID) - slice_cpu_start_ns);
+        max_slice_wall_ns = std::max(max_slice_wall_ns, now - slice_wall_start_ns);
+        slices++;
+        stats_record("slice_count", "%u", slices);
+        stats_record("slice_max_cpu_us", "%lld", (long long) (max_slice_cpu_ns / 1000));
+        stats_record("slice_max_wall_us", "%lld", (long long) (max_slice_wall_ns / 1000));
+        stats_record("slice_paused_ms", "%lld", (long long) (paused_ns / 1000000));
+    }
+    stats_record("dump_types_per_sec", "%.1f", wall_ns > 0 ? items * 1e9 / (double) wall_ns : 0.0);
+}
@@ -0,0 +1,43 @@
+//
+// Cooperative time slicing for the dump loop: work runs in slices of at most budget_us of thread
+// CPU time, with a pause between slices so the game's threads get the il2cpp metadata locks back.
+//
+
+#ifndef ZYGISK_IL2CPPDUMPER_TIME_SLICE_H
+#define ZYGISK_IL2CPPDUMPER_TIME_SLICE_H
+
+#include <stdint.h>
+
+// Position of the dump loop: the next class to visit. Slices end between two classes, and the
+// loop resumes from here after the pause.
+struct DumpCursor {
+    uint32_t image;
+    uint32_t klass;
+};
+
+class TimeSlicer {
+public:
+    // budget_us <= 0 disables slicing. pause_us == 0 only yields the CPU between slices.
+    TimeSlicer(int32_t budget_us, int32_t pause_us);
+
+    // Called after each class. Ends the current slice and pauses once its budget is spent.
+    void tick(const DumpCursor &cursor);
+
+    // Records slice count, longest slice and throughput in the stats.
+    void finish(uint32_t items);
+
+private:
+    void start_slice();
+
+    int64_t budget_ns;
+    int64_t pause_ns;
+    int64_t dump_start_ns;
+    int64_t slice_cpu_start_ns = 0;
+    int64_t slice_wall_start_ns = 0;
+    int64_t max_slice_cpu_ns = 0;
+    int64_t max_slice_wall_ns = 0;
+    int64_t paused_ns = 0;
+    uint32_t slices = 0;
+};
+
+#endif //ZYGISK_IL2CPPDUMPER_TIME_SLICE_H
@@ -0,0 +1,298 @@
+//
+// Identifies the il2cpp runtime and caches the result per libil2cpp.so build-id.
+//
+
+#include <link.h>
+#include <linux/limits.h>
+#include <algorithm>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include "xdl.h"
+#include "log.h"
+#include "memory_io.h"
+#include "metadata_scan.h"
+#include "stats.h"
+#include "il2cpp-class.h"
+#include "version_detect.h"
+
+static std::vector<const char *> api_names() {
+    std::vector<const char *> names;
+#define DO_API(r, n, p) names.push_back(#n)
+
+#include "il2cpp-api-functions.h"
+
+#undef DO_API
+    return names;
+}
+
+static Il2CppVersion current_version{};
+
+static void read_build_id(const void *il2cpp_address, Il2CppVersion *version) {
+    memory_find_module((uintptr_t) il2cpp_address, nullptr, [&](const dl_phdr_info *info) {
+        for (int i = 0; i < info->dlpi_phnum; ++i) {
+            auto &phdr = info->dlpi_phdr[i];
+            if (phdr.p_type != PT_NOTE) {
+                continue;
+            }
+            auto note = (const char *) (info->dlpi_addr + phdr.p_vaddr);
+            auto end = note + phdr.p_memsz;
+            while (note + sizeof(ElfW(Nhdr)) <= end) {
+                auto header = (const ElfW(Nhdr) *) note;
+                auto name = note + sizeof(ElfW(Nhdr));
+                auto desc = name + ((header->n_namesz + 3) & ~3u);
+                if (desc + header->n_descsz > end) {
+                    break;
+                }
+                if (header->n_type == NT_GNU_BUILD_ID && header->n_namesz == 4 && memcmp(name, "GNU", 4) == 0) {
+                    auto size = std::min<size_t>(header->n_descsz, (sizeof(version->build_id) - 1) / 2);
+                    for (size_t j = 0; j < size; ++j) {
+                        snprintf(version->build_id + j * 2, 3, "%02x", (uint8_t) desc[j]);
+                    }
+                    return;
+                }
+                note = desc + ((header->n_descsz + 3) & ~3u);
+            }
+        }
+    });
+}
+
+static void read_exports(void *il2cpp_handle, Il2CppVersion *version) {
+    uint64_t hash = 0xcbf29ce484222325;
+    auto names = api_names();
+    for (size_t i = 0; i < names.size(); ++i) {
+        auto present = xdl_sym(il2cpp_handle, names[i], nullptr) != nullptr;
+        version->exports += present;
+        hash = (hash ^ (present ? 0x80 | (i & 0x7f) : i & 0x7f)) * 0x100000001b3;
+    }
+    version->exports_hash = hash;
+}
+
+static size_t digits(const char *p, const char *end) {
+    size_t n = 0;
+    while (p + n < end && p[n] >= '0' && p[n] <= '9') {
+        n++;
+    }
+    return n;
+}
+
+// Matches a whole NUL-terminated "2021.3.5f1" / "5.6.7p3" string starting at p.
+static size_t match_unity_version(const char *p, const char *end) {
+    auto start = p;
+    auto year = digits(p, end);
+    if (year != 4 && !(year == 1 && (*p == '5' || *p == '6'))) {
+        return 0;
+    }
+    p += year;
+    for (int part = 0; part < 2; ++part) {
+        if (p >= end || *p != '.') {
+            return 0;
+        }
+        auto n = digits(++p, end);
+        if (n == 0 || n > 3) {
+            return 0;
+        }
+        p += n;
+    }
+    if (p >= end || *p == '\0' || !strchr("abfpx", *p)) {
+        return 0;
+    }
+    auto n = digits(++p, end);
+    if (n == 0 || p + n >= end || p[n] != '\0') {
+        return 0;
+    }
+    return p + n - start;
+}
+
+// libunity.so is read in chunks through memory_read: packers may leave unreadable holes in its segments.
+static constexpr size_t kUnityChunk = 64 * 1024;
+// Context kept around each chunk: the NUL before a candidate and the longest version that fits.
+static constexpr size_t kUnityOverlap = sizeof(Il2CppVersion::unity) + 1;
+
+// Looks at the '.' in [from, to) of the buffer [begin, end) for the first version string.
+static bool find_unity_version(const char *begin, const char *from, const char *to, const char *end,
+                               Il2CppVersion *version) {
+    // Candidates start right after a NUL; memchr jumps from one '.' to the next.
+    for (auto dot = from; dot < to && (dot = (const char *) memchr(dot, '.', to - dot)); ++dot) {
+        auto start = dot;
+        while (start > begin && start[-1] >= '0' && start[-1] <= '9') {
+            start--;
+        }
+        if (start == dot || start == begin || start[-1] != '\0') {
+            continue;
+        }
+        auto length = match_unity_version(start, end);
+        if (length && length < sizeof(version->unity)) {
+            memcpy(version->unity, start, length);
+            version->unity[length] = '\0';
+            return true;
+        }
+    }
+    return false;
+}
+
+static void read_unity_version(Il2CppVersion *version) {
+    memory_find_module(0, "libunity.so", [&](const dl_phdr_info *info) {
+        std::vector<char> buffer(kUnityOverlap + kUnityChunk + kUnityOverlap);
+        for (int i = 0; i < info->dlpi_phnum; ++i) {
+            auto &phdr = info->dlpi_phdr[i];
+            if (phdr.p_type != PT_LOAD || !(phdr.p_flags & PF_R)) {
+                continue;
+            }
+            auto begin = info->dlpi_addr + phdr.p_vaddr;
+            auto end = begin + phdr.p_filesz;
+            for (auto chunk = begin; chunk < end; chunk += kUnityChunk) {
+                // The window starts kUnityOverlap before the chunk and ends kUnityOverlap after it, so a
+                // version string crossing a chunk boundary is still read whole.
+                auto window = chunk - std::min<uintptr_t>(chunk - begin, kUnityOverlap);
+                auto size = memory_read(window, buffer.data(), std::min<uintptr_t>(end - window, buffer.size()));
+                auto data = buffer.data();
+                auto from = data + (chunk - window);
+                auto to = data + std::min<size_t>(size, chunk - window + kUnityChunk);
+                if (from < to && find_unity_version(data, from, to, data + size, version)) {
+                    return;
+                }
+            }
+        }
+    });
+}
+
+// Only finds the header when global-metadata.dat is mapped as a file of its own.
+static void read_metadata_version(Il2CppVersion *version) {
+    auto maps = fopen("/proc/self/maps", "re");
+    if (!maps) {
+        return;
+    }
+    char line[PATH_MAX + 128];
+    while (fgets(line, sizeof(line), maps)) {
+        uintptr_t start;
+        char perms[5];
+        if (!strstr(line, "global-metadata.dat") ||
+            sscanf(line, "%" SCNxPTR "-%*x %4s", &start, perms) != 2 || perms[0] != 'r') {
+            continue;
+        }
+        uint32_t header[2];
+        if (memory_read(start, header, sizeof(header)) == sizeof(header) && header[0] == kMetadataSanity) {
+            version->metadata_version = header[1];
+            break;
+        }
+    }
+    fclose(maps);
+}
+
+static StructLayout layout_for(const Il2CppVersion &version, bool has_image_get_class) {
+    if (version.metadata_version >= 29) {
+        return StructLayout::v29;
+    }
+    if (version.metadata_version == 27) {
+        return StructLayout::v24_1;
+    }
+    int year = 0, minor = 0;
+    if (sscanf(version.unity, "%d.%d", &year, &minor) == 2) {
+        if (year > 2021 || (year == 2021 && minor >= 2)) {
+            return StructLayout::v29;
+        }
+        if (year > 2018 || (year == 2018 && minor >= 3)) {
+            return StructLayout::v24_1;
+        }
+        return StructLayout::v24_0;
+    }
+    if (version.metadata_version == 24) {
+        return has_image_get_class ? StructLayout::v24_1 : StructLayout::v24_0;
+    }
+    return StructLayout::api;
+}
+
+static std::string cache_path(const char *game_data_dir) {
+    return std::string(game_data_dir).append("/files/il2cpp_version.txt");
+}
+
+static bool load_cached(const char *game_data_dir, Il2CppVersion *version) {
+    auto file = fopen(cache_path(game_data_dir).c_str(), "re");
+    if (!file) {
+        return false;
+    }
+    Il2CppVersion cached{};
+    char line[256];
+    char layout[16] = "";
+    while (fgets(line, sizeof(line), file)) {
+        line[strcspn(line, "\n")] = '\0';
+        auto eq = strchr(line, '=');
+        if (!eq) {
+            continue;
+        }
+        *eq = '\0';
+        auto value = eq + 1;
+        if (strcmp(line, "build_id") == 0) {
+            strlcpy(cached.build_id, value, sizeof(cached.build_id));
+        } else if (strcmp(line, "unity") == 0) {
+            strlcpy(cached.unity, value, sizeof(cached.unity));
+        } else if (strcmp(line, "metadata_version") == 0) {
+            cached.metadata_version = (uint32_t) strtoul(value, nullptr, 10);
+        } else if (strcmp(line, "exports") == 0) {
+            cached.exports = (uint32_t) strtoul(value, nullptr, 10);
+        } else if (strcmp(line, "exports_hash") == 0) {
+            cached.exports_hash = strtoull(value, nullptr, 16);
+        } else if (strcmp(line, "layout") == 0) {
+            strlcpy(layout, value, sizeof(layout));
+        }
+    }
+    fclose(file);
+    if (strcmp(cached.build_id, version->build_id) != 0) {
+        return false;
+    }
+    for (auto candidate: {StructLayout::v24_0, StructLayout::v24_1, StructLayout::v29}) {
+        if (strcmp(layout, struct_layout_name(candidate)) == 0) {
+            cached.layout = candidate;
+        }
+    }
+    cached.cached = true;
+    *version = cached;
+    return true;
+}
+
+static void store_cached(const char *game_data_dir, const Il2CppVersion &version) {
+    auto path = cache_path(game_data_dir);
+    auto file = fopen(path.c_str(), "we");
+    if (!file) {
+        LOGW("Unable to open %s", path.c_str());
+        return;
+    }
+    fprintf(file, "build_id=%s\nunity=%s\nmetadata_version=%u\nexports=%u\nexports_hash=%016" PRIx64 "\nlayout=%s\n",
+            version.build_id, version.unity, version.metadata_version, version.exports, version.exports_hash,
+            struct_layout_name(version.layout));
+    fclose(file);
+}
+
+const Il2CppVersion &il2cpp_version_detect(void *il2cpp_handle, const void *il2cpp_address,
+                                           const char *game_data_dir) {
+    Il2CppVersion version{};
+    read_build_id(il2cpp_address, &version);
+    // Without a build-id the cache cannot be validated, so detection always runs.
+    if (!version.build_id[0] || !load_cached(game_data_dir, &version)) {
+        read_exports(il2cpp_handle, &version);
+        read_unity_version(&version);
+        read_metadata_version(&version);
+        version.layout = layout_for(version, xdl_sym(il2cpp_handle, "il2cpp_image_get_class", nullptr));
+        if (version.build_id[0]) {
+            store_cached(game_data_dir, version);
+        }
+    }
+    LOGI("il2cpp version: unity %s, metadata v%u, %u exports, layout %s%s", version.unity[0] ? version.unity : "?",
+         version.metadata_version, version.exports, struct_layout_name(version.layout),
+         version.cached ? " (cached)" : "");
+    stats_record("il2cpp_build_id", "%s", version.build_id);
+    stats_record("il2cpp_unity", "%s", version.unity);
+    stats_record("il2cpp_metadata_version", "%u", version.metadata_version);
+    stats_record("il2cpp_exports", "%u", version.exports);
+    stats_record("il2cpp_version_cached", "%d", version.cached);
+    current_version = version;
+    return current_version;
+}
+
+const Il2CppVersion &il2cpp_version_get() {
+    return current_version;
+}
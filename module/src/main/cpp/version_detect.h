@@ -0,0 +1,33 @@
+//
+// Identifies the il2cpp runtime: which il2cpp-api-functions.h exports libil2cpp.so has, the Unity
+// version string in libunity.so and the global-metadata.dat header version. The result is cached
+// in <game_data_dir>/files/il2cpp_version.txt, keyed by libil2cpp.so's build-id, so later launches
+// of the same build skip the scans.
+//
+// il2cpp-class.h has no include guard, so this header expects it to be included first.
+//
+
+#ifndef ZYGISK_IL2CPPDUMPER_VERSION_DETECT_H
+#define ZYGISK_IL2CPPDUMPER_VERSION_DETECT_H
+
+#include <stdint.h>
+#include "struct_layout.h"
+
+struct Il2CppVersion {
+    char build_id[41];         // hex NT_GNU_BUILD_ID of libil2cpp.so, empty if it has none
+    char unity[32];            // e.g. "2021.3.5f1", empty when libunity.so has no version string
+    uint32_t metadata_version; // global-metadata.dat header version, 0 when the header was not found
+    uint32_t exports;          // how many il2cpp-api-functions.h exports resolve
+    uint64_t exports_hash;     // hash of which of them resolve
+    StructLayout layout;       // struct layout expected for this version, StructLayout::api if unknown
+    bool cached;               // read from il2cpp_version.txt instead of detected
+};
+
+// il2cpp_address is any address inside libil2cpp.so.
+const Il2CppVersion &il2cpp_version_detect(void *il2cpp_handle, const void *il2cpp_address,
+                                           const char *game_data_dir);
+
+// Result of the last il2cpp_version_detect, all fields zero before it.
+const Il2CppVersion &il2cpp_version_get();
+
+#endif //ZYGISK_IL2CPPDUMPER_VERSION_DETECT_H
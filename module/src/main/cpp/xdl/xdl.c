@@ -44,6 +44,7 @@
 #include "xdl_iterate.h"
 #include "xdl_linker.h"
 #include "xdl_lzma.h"
+#include "xdl_registry.h"
 #include "xdl_util.h"
 
 #ifndef __LP64__
@@ -489,9 +490,10 @@ static xdl_t *xdl_find(const char *filename) {
 
   if (NULL != self) return self;
 
-  // from dl_iterate_phdr
+  // from the registry (a cached dl_iterate_phdr snapshot), or dl_iterate_phdr if it is unavailable
   uintptr_t pkg[2] = {(uintptr_t)&self, (uintptr_t)filename};
-  xdl_iterate_phdr(xdl_find_iterate_cb, pkg, XDL_DEFAULT);
+  if (xdl_registry_find(filename, xdl_find_iterate_cb, pkg) < 0)
+    xdl_iterate_phdr(xdl_find_iterate_cb, pkg, XDL_DEFAULT);
   return self;
 }
 
@@ -0,0 +1,201 @@
+// Copyright (c) 2020-2021 HexHacking Team
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+#include "xdl_registry.h"
+
+#include <link.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "xdl.h"
+#include "xdl_util.h"
+
+#define XDL_REGISTRY_BUCKETS_CNT 256  // power of 2
+
+extern __attribute((weak)) int dl_iterate_phdr(int (*)(struct dl_phdr_info *, size_t, void *), void *);
+
+typedef struct xdl_registry_entry {
+  struct dl_phdr_info info;  // dlpi_name points to pathname
+  char *pathname;
+  const char *basename;
+  uint32_t hash;
+  struct xdl_registry_entry *bucket_next;  // same bucket, in load order
+  struct xdl_registry_entry *next;         // all entries, in load order
+} xdl_registry_entry_t;
+
+typedef struct {
+  bool valid;
+  unsigned long long adds;
+  unsigned long long subs;
+  xdl_registry_entry_t *head;
+  xdl_registry_entry_t **tail;
+  xdl_registry_entry_t *buckets[XDL_REGISTRY_BUCKETS_CNT];
+  xdl_registry_entry_t *bucket_tails[XDL_REGISTRY_BUCKETS_CNT];
+} xdl_registry_t;
+
+static xdl_registry_t xdl_registry;
+static pthread_mutex_t xdl_registry_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static const char *xdl_registry_basename(const char *pathname) {
+  const char *slash = strrchr(pathname, '/');
+  return NULL == slash ? pathname : slash + 1;
+}
+
+static uint32_t xdl_registry_hash(const char *str) {
+  // FNV-1a
+  uint32_t h = 2166136261u;
+  while (*str) {
+    h ^= (uint8_t)*str++;
+    h *= 16777619u;
+  }
+  return h;
+}
+
+typedef struct {
+  bool ok;
+  unsigned long long adds;
+  unsigned long long subs;
+} xdl_registry_counters_t;
+
+static int xdl_registry_counters_cb(struct dl_phdr_info *info, size_t size, void *arg) {
+  xdl_registry_counters_t *counters = (xdl_registry_counters_t *)arg;
+
+  // dlpi_adds and dlpi_subs were added in Android 11 (API level 30)
+  if (size >= offsetof(struct dl_phdr_info, dlpi_subs) + sizeof(info->dlpi_subs)) {
+    counters->ok = true;
+    counters->adds = info->dlpi_adds;
+    counters->subs = info->dlpi_subs;
+  }
+  return 1;  // the first ELF is enough
+}
+
+static bool xdl_registry_get_counters(unsigned long long *adds, unsigned long long *subs) {
+  if (NULL == dl_iterate_phdr) return false;
+
+  xdl_registry_counters_t counters = {false, 0, 0};
+  dl_iterate_phdr(xdl_registry_counters_cb, &counters);
+  if (!counters.ok) return false;
+
+  *adds = counters.adds;
+  *subs = counters.subs;
+  return true;
+}
+
+static void xdl_registry_clear(void) {
+  xdl_registry_entry_t *entry = xdl_registry.head;
+  while (NULL != entry) {
+    xdl_registry_entry_t *tmp = entry;
+    entry = entry->next;
+    free(tmp->pathname);
+    free(tmp);
+  }
+  memset(&xdl_registry, 0, sizeof(xdl_registry));
+  xdl_registry.tail = &xdl_registry.head;
+}
+
+static int xdl_registry_collect_cb(struct dl_phdr_info *info, size_t size, void *arg) {
+  (void)size, (void)arg;
+
+  if (0 == info->dlpi_addr || NULL == info->dlpi_name) return 0;
+
+  xdl_registry_entry_t *entry = calloc(1, sizeof(xdl_registry_entry_t));
+  if (NULL == entry) return 1;  // failed
+  if (NULL == (entry->pathname = strdup(info->dlpi_name))) {
+    free(entry);
+    return 1;  // failed
+  }
+  entry->info.dlpi_addr = info->dlpi_addr;
+  entry->info.dlpi_name = entry->pathname;
+  entry->info.dlpi_phdr = info->dlpi_phdr;
+  entry->info.dlpi_phnum = info->dlpi_phnum;
+  entry->basename = xdl_registry_basename(entry->pathname);
+  entry->hash = xdl_registry_hash(entry->basename);
+
+  *xdl_registry.tail = entry;
+  xdl_registry.tail = &entry->next;
+
+  size_t idx = entry->hash & (XDL_REGISTRY_BUCKETS_CNT - 1);
+  if (NULL == xdl_registry.bucket_tails[idx])
+    xdl_registry.buckets[idx] = entry;
+  else
+    xdl_registry.bucket_tails[idx]->bucket_next = entry;
+  xdl_registry.bucket_tails[idx] = entry;
+  return 0;
+}
+
+static bool xdl_registry_refresh(void) {
+  unsigned long long adds, subs;
+  if (!xdl_registry_get_counters(&adds, &subs)) return false;
+  if (xdl_registry.valid && adds == xdl_registry.adds && subs == xdl_registry.subs) return true;
+
+  do {
+    xdl_registry_clear();
+    if (0 != xdl_iterate_phdr(xdl_registry_collect_cb, NULL, XDL_DEFAULT)) {
+      // out of memory, keep the registry invalid
+      xdl_registry_clear();
+      return false;
+    }
+    xdl_registry.adds = adds;
+    xdl_registry.subs = subs;
+    // something was loaded or unloaded while we were walking, try again
+    if (!xdl_registry_get_counters(&adds, &subs)) return false;
+  } while (adds != xdl_registry.adds || subs != xdl_registry.subs);
+
+  xdl_registry.valid = true;
+  return true;
+}
+
+int xdl_registry_find(const char *filename, xdl_registry_cb_t cb, void *cb_arg) {
+  if (NULL == filename || NULL == cb) return -1;
+
+  pthread_mutex_lock(&xdl_registry_lock);
+  if (!xdl_registry_refresh()) {
+    pthread_mutex_unlock(&xdl_registry_lock);
+    return -1;
+  }
+
+  int r = 0;
+  const char *basename = xdl_registry_basename(filename);
+  uint32_t hash = xdl_registry_hash(basename);
+
+  // fast path: entries with the same basename
+  for (xdl_registry_entry_t *entry = xdl_registry.buckets[hash & (XDL_REGISTRY_BUCKETS_CNT - 1)];
+       NULL != entry; entry = entry->bucket_next) {
+    if (entry->hash != hash || 0 != strcmp(entry->basename, basename)) continue;
+    if (0 != (r = cb(&entry->info, sizeof(struct dl_phdr_info), cb_arg))) goto end;
+  }
+
+  // slow path: suffix matches that do not start at a '/' boundary, still without a linker walk
+  if (basename != filename) goto end;
+  for (xdl_registry_entry_t *entry = xdl_registry.head; NULL != entry; entry = entry->next) {
+    if (entry->hash == hash && 0 == strcmp(entry->basename, basename)) continue;
+    if (!xdl_util_ends_with(entry->pathname, basename)) continue;
+    if (0 != (r = cb(&entry->info, sizeof(struct dl_phdr_info), cb_arg))) goto end;
+  }
+
+end:
+  pthread_mutex_unlock(&xdl_registry_lock);
+  return r;
+}
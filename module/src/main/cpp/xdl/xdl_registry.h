@@ -0,0 +1,49 @@
+// Copyright (c) 2020-2021 HexHacking Team
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+// Process-wide registry of loaded ELFs, keyed by basename.
+//
+// The registry is a snapshot of dl_iterate_phdr(3). It is rebuilt only when the linker's
+// dlpi_adds/dlpi_subs counters (Android 11+) differ from the ones recorded with the snapshot,
+// so repeated lookups and misses cost a counter comparison instead of a full linker walk.
+
+#ifndef IO_HEXHACKING_XDL_REGISTRY
+#define IO_HEXHACKING_XDL_REGISTRY
+
+#include <link.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef int (*xdl_registry_cb_t)(struct dl_phdr_info *info, size_t size, void *arg);
+
+// Calls cb for the cached ELFs that may match filename, stopping at the first non-zero return.
+// Returns the last value returned by cb (0 if no entry was accepted), or -1 if the linker does not
+// report load/unload counters and the caller has to walk the linker itself.
+int xdl_registry_find(const char *filename, xdl_registry_cb_t cb, void *cb_arg);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
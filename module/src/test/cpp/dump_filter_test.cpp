@@ -0,0 +1,53 @@
+//
+// Filter rules against image, namespace and type names, including the "*" rules that only mark
+// the trie's root.
+//
+
+#include "dump_filter.h"
+#include "test.h"
+
+static void test_root_prefix() {
+    DumpFilter filter;
+    filter.compile("-namespace:*");
+    CHECK(!filter.empty());
+    CHECK(!filter.accept_class("Game", "Player"));
+    CHECK(!filter.accept_class("", "Global"));
+    CHECK(filter.classes_rejected == 2);
+
+    DumpFilter include_all;
+    include_all.compile("+type:*\n-type:Game.Secret");
+    CHECK(include_all.accept_class("Game", "Player"));
+    CHECK(!include_all.accept_class("Game", "Secret"));
+}
+
+static void test_kinds() {
+    DumpFilter filter;
+    filter.compile("+image:Assembly-CSharp.dll\n"
+                   "+image:Game.*.dll\n"
+                   "-namespace:UnityEngine*\n"
+                   "-type:*.Debug?\n"
+                   "bogus line\n");
+    CHECK(filter.accept_image("Assembly-CSharp.dll"));
+    CHECK(filter.accept_image("Game.Core.dll"));
+    CHECK(!filter.accept_image("mscorlib.dll"));
+    CHECK(filter.images_rejected == 1);
+    CHECK(filter.accept_class("Game", "Player"));
+    CHECK(!filter.accept_class("UnityEngine.UI", "Button"));
+    CHECK(!filter.accept_class("Game", "Debug1"));
+    CHECK(filter.accept_class("Game", "Debug"));
+}
+
+static void test_empty() {
+    DumpFilter filter;
+    filter.compile("");
+    CHECK(filter.empty());
+    CHECK(filter.accept_image("anything.dll"));
+    CHECK(filter.accept_class("Any", "Type"));
+}
+
+int main() {
+    test_root_prefix();
+    test_kinds();
+    test_empty();
+    return TEST_RESULT();
+}
@@ -0,0 +1,141 @@
+//
+// The store must reuse an image dumped again at another load address, and the dump.cs it assembles
+// must be the one formatted directly from the records.
+//
+
+#include <dirent.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <cstring>
+#include <string>
+#include <vector>
+#include "dump_format.h"
+#include "dump_record.h"
+#include "dump_store.h"
+#include "test.h"
+
+// Enough types for one image to span several formatting chunks.
+static constexpr uint32_t kLargeImageTypes = 3000;
+
+static std::vector<TypeRecord> make_types(uint64_t base) {
+    std::vector<TypeRecord> types;
+    for (uint32_t image = 0; image < 2; ++image) {
+        auto count = image == 0 ? 3 : kLargeImageTypes;
+        for (uint32_t i = 0; i < count; ++i) {
+            TypeRecord type{};
+            type.image_index = image;
+            type.namespaze = "Game";
+            type.name = "Type" + std::to_string(i);
+            for (uint32_t j = 0; j < 4; ++j) {
+                MethodRecord method{};
+                method.name = "Method" + std::to_string(j);
+                method.return_type = "void";
+                // The last method has no compiled body.
+                if (j < 3) {
+                    method.rva = 0x100000 + (image * kLargeImageTypes + i) * 0x40 + j * 0x10;
+                    method.va = base + method.rva;
+                }
+                type.methods.push_back(method);
+            }
+            types.push_back(type);
+        }
+    }
+    return types;
+}
+
+static std::string dump(DumpStore &store, const std::vector<std::string> &images, uint64_t base) {
+    std::string out;
+    StoreFormatter formatter(store, images, "com.example.game", base, [&](const std::string &text) {
+        out.append(text);
+        return true;
+    });
+    for (auto &type: make_types(base)) {
+        CHECK(formatter.add(type));
+    }
+    CHECK(formatter.finish());
+    return out;
+}
+
+static std::string expected(const std::vector<std::string> &images, uint64_t base) {
+    std::string out;
+    for (auto &type: make_types(base)) {
+        format_type(type, images[type.image_index], &out);
+    }
+    return out;
+}
+
+static void test_hasher_split() {
+    std::string data(1000, '\0');
+    for (size_t i = 0; i < data.size(); ++i) {
+        data[i] = (char) (i * 31 + 7);
+    }
+    auto whole = hash128(data.data(), data.size());
+    for (size_t split: {0, 1, 15, 16, 17, 500, 999}) {
+        Hasher128 hasher;
+        hasher.update(data.data(), split);
+        hasher.update(data.data() + split, data.size() - split);
+        auto parts = hasher.final();
+        CHECK(parts.low == whole.low && parts.high == whole.high);
+    }
+}
+
+static void test_reuse_across_bases() {
+    char root[] = "/tmp/dump_store_test.XXXXXX";
+    CHECK(mkdtemp(root) != nullptr);
+    std::vector<std::string> images = {"Assembly-CSharp.dll", "mscorlib.dll"};
+
+    DumpStore first(root);
+    CHECK(first.open());
+    auto first_text = dump(first, images, 0x7000000000);
+    CHECK(first_text == expected(images, 0x7000000000));
+    CHECK(first.stored == 2 && first.reused == 0);
+
+    // Same records, another launch: only the VAs differ, every image comes from the store.
+    DumpStore second(root);
+    CHECK(second.open());
+    auto second_text = dump(second, images, 0x7100000000);
+    CHECK(second_text == expected(images, 0x7100000000));
+    CHECK(second.reused == 2 && second.stored == 0 && second.deduplicated == 0);
+    CHECK(second_text.find("VA: 0x7100100000") != std::string::npos);
+    CHECK(second_text.find("VA: 0x70001") == std::string::npos);
+
+    std::string command = std::string("rm -rf ") + root;
+    CHECK(system(command.c_str()) == 0);
+}
+
+static size_t count_manifests(const std::string &dir, const char *prefix) {
+    size_t count = 0;
+    if (auto entries = opendir(dir.c_str())) {
+        while (auto entry = readdir(entries)) {
+            count += strncmp(entry->d_name, prefix, strlen(prefix)) == 0;
+        }
+        closedir(entries);
+    }
+    return count;
+}
+
+// Runs within the same second get their own manifest, and only the newest ones are kept.
+static void test_manifest_rotation() {
+    char root[] = "/tmp/dump_store_test.XXXXXX";
+    CHECK(mkdtemp(root) != nullptr);
+    DumpStore store(root);
+    CHECK(store.open());
+    auto dir = std::string(root) + "/manifests";
+    for (size_t i = 0; i < kStoreManifestsKept + 4; ++i) {
+        CHECK(store.write_manifest("com.example.game", "run " + std::to_string(i) + "\n"));
+        CHECK(count_manifests(dir, "com.example.game-") == std::min<size_t>(i + 1, kStoreManifestsKept));
+    }
+    CHECK(store.write_manifest("com.example.other", "run\n"));
+    CHECK(count_manifests(dir, "com.example.game-") == kStoreManifestsKept);
+    CHECK(count_manifests(dir, "com.example.other-") == 1);
+
+    std::string command = std::string("rm -rf ") + root;
+    CHECK(system(command.c_str()) == 0);
+}
+
+int main() {
+    test_hasher_split();
+    test_reuse_across_bases();
+    test_manifest_rotation();
+    return TEST_RESULT();
+}
@@ -0,0 +1,29 @@
+//
+// Host stand-in for the NDK's <android/log.h>: log lines go to stderr.
+//
+
+#ifndef ZYGISK_IL2CPPDUMPER_TEST_ANDROID_LOG_H
+#define ZYGISK_IL2CPPDUMPER_TEST_ANDROID_LOG_H
+
+#include <stdarg.h>
+#include <stdio.h>
+
+enum {
+    ANDROID_LOG_DEBUG = 3,
+    ANDROID_LOG_INFO = 4,
+    ANDROID_LOG_WARN = 5,
+    ANDROID_LOG_ERROR = 6,
+};
+
+__attribute__((format(printf, 3, 4)))
+static inline int __android_log_print(int prio, const char *tag, const char *fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    fprintf(stderr, "%c/%s: ", "??VDIWE"[prio < 7 ? prio : 0], tag);
+    int n = vfprintf(stderr, fmt, args);
+    fputc('\n', stderr);
+    va_end(args);
+    return n;
+}
+
+#endif //ZYGISK_IL2CPPDUMPER_TEST_ANDROID_LOG_H
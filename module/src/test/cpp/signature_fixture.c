@@ -0,0 +1,16 @@
+//
+// Shared library that the signature scan test loads and runs through SignatureSet::scan_module: a
+// read-only table with a pattern placed at build time, and a writable table the test fills in.
+//
+
+#define SIGNATURE_FIXTURE_PAGES 64
+
+// Initialized so it lands in .data, inside the file size of its PT_LOAD, and not in .bss.
+__attribute__((aligned(4096))) unsigned char signature_fixture_data[SIGNATURE_FIXTURE_PAGES * 4096] = {1};
+
+const unsigned long signature_fixture_data_size = sizeof(signature_fixture_data);
+
+// nop; "FD 7B ?? A9 FD 03 00 91" at offset 4; ret.
+const unsigned char signature_fixture_rodata[] = {
+        0x1F, 0x20, 0x03, 0xD5, 0xFD, 0x7B, 0xBF, 0xA9, 0xFD, 0x03, 0x00, 0x91, 0xC0, 0x03, 0x5F, 0xD6,
+};
@@ -0,0 +1,173 @@
+//
+// Throughput of SignatureSet::scan over synthetic code, and a check that every planted pattern is
+// found. Built twice: with the SSE2/NEON anchor search and with SIGNATURE_SCAN_SCALAR, so the two
+// runs compare the vector path against the byte loop. The argument is the buffer size in MiB.
+// scan_module is checked on SIGNATURE_FIXTURE, a small shared library whose mappings are split and
+// partly revoked with mprotect.
+//
+
+#include <dlfcn.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#include "signature_scan.h"
+#include "test.h"
+
+static constexpr int kRuns = 5;
+static constexpr size_t kPlantsPerPattern = 4;
+
+// arm64-like instruction words with IDA-style wildcards over their immediates.
+static const char *const kPatterns[] = {
+        "FD 7B ?? A9 FD 03 00 91",
+        "F4 4F ?? A9 F3 03 00 AA",
+        "?? ?? 40 F9 ?? 01 00 B4",
+        "E0 03 13 AA ?? ?? ?? 94",
+        "1F 20 03 D5 ?? ?? ?? 58",
+        "C0 03 5F D6 FD 7B BF A9",
+        "?? 0A 40 B9 ?? 05 00 51",
+        "E1 03 1F 2A ?? ?? ?? 97",
+        "08 ?? 40 F9 08 ?? ?? B5",
+        "68 ?? ?? 90 08 ?? ?? 91",
+        "3F 00 00 71 ?? ?? 00 54",
+        "F5 5B ?? A9 F7 63 ?? A9",
+        "?? ?? ?? 52 ?? ?? ?? 72",
+        "E8 03 00 32 1F 01 00 6B",
+        "60 02 40 F9 ?? ?? ?? 17",
+        "A8 83 5F F8 1F 01 09 EB",
+};
+static constexpr size_t kPatternCount = sizeof(kPatterns) / sizeof(kPatterns[0]);
+
+static uint32_t next_random(uint64_t *state) {
+    *state ^= *state << 13;
+    *state ^= *state >> 7;
+    *state ^= *state << 17;
+    return (uint32_t) *state;
+}
+
+// Bytes of pattern with the wildcards filled in.
+static std::vector<uint8_t> instance(const char *pattern, uint64_t *state) {
+    std::vector<uint8_t> bytes;
+    for (auto p = pattern; *p;) {
+        if (*p == ' ') {
+            p++;
+        } else if (*p == '?') {
+            bytes.push_back((uint8_t) next_random(state));
+            p += 2;
+        } else {
+            bytes.push_back((uint8_t) strtoul(std::string(p, 2).c_str(), nullptr, 16));
+            p += 2;
+        }
+    }
+    return bytes;
+}
+
+static bool found(const SignatureSet &set, size_t index, uintptr_t offset) {
+    auto &matches = set.matches(index);
+    return std::find(matches.begin(), matches.end(), offset) != matches.end();
+}
+
+// Offsets are relative to the load bias, across the read-only and the writable PT_LOAD. A pattern
+// crossing two adjacent readable mappings must be found, one on a PROT_NONE page must be skipped.
+static void check_module(uint64_t *state) {
+    auto handle = dlopen(SIGNATURE_FIXTURE, RTLD_NOW);
+    CHECK(handle);
+    if (!handle) {
+        fprintf(stderr, "%s\n", dlerror());
+        return;
+    }
+    auto data = (uint8_t *) dlsym(handle, "signature_fixture_data");
+    auto size = *(const unsigned long *) dlsym(handle, "signature_fixture_data_size");
+    auto rodata = (const uint8_t *) dlsym(handle, "signature_fixture_rodata");
+    Dl_info info{};
+    CHECK(dladdr(data, &info));
+    auto bias = (uintptr_t) info.dli_fbase;
+    auto page = (size_t) sysconf(_SC_PAGESIZE);
+    CHECK(size >= 32 * page);
+
+    for (size_t i = 0; i + 4 <= size; i += 4) {
+        auto word = next_random(state);
+        memcpy(&data[i], &word, sizeof(word));
+    }
+    auto plant = [&](size_t k, size_t offset) {
+        auto bytes = instance(kPatterns[k], state);
+        memcpy(&data[offset], bytes.data(), bytes.size());
+        return (uintptr_t) (data + offset) - bias;
+    };
+    auto inside = plant(1, 4 * page + 100);
+    auto crossing = plant(2, 9 * page - 4);
+    auto revoked = plant(3, 16 * page + 200);
+    // rw- | r-x | rw- around the crossing pattern, and a hole at the revoked one.
+    CHECK(mprotect(data + 9 * page, page, PROT_READ | PROT_EXEC) == 0);
+    CHECK(mprotect(data + 16 * page, page, PROT_NONE) == 0);
+
+    SignatureSet set;
+    for (size_t k = 0; k < 4; ++k) {
+        CHECK(set.add(("p" + std::to_string(k)).c_str(), kPatterns[k]));
+    }
+    CHECK(set.scan_module(data));
+    CHECK(found(set, 0, (uintptr_t) (rodata + 4) - bias));
+    CHECK(found(set, 1, inside));
+    CHECK(found(set, 2, crossing));
+    CHECK(!found(set, 3, revoked));
+
+    mprotect(data + 9 * page, page, PROT_READ | PROT_WRITE);
+    mprotect(data + 16 * page, page, PROT_READ | PROT_WRITE);
+    dlclose(handle);
+}
+
+int main(int argc, char **argv) {
+    size_t size = (argc > 1 ? strtoul(argv[1], nullptr, 10) : 64) << 20;
+    std::vector<uint8_t> code(size);
+    uint64_t state = 0x9e3779b97f4a7c15ull;
+    for (size_t i = 0; i + 4 <= size; i += 4) {
+        auto word = next_random(&state);
+        memcpy(&code[i], &word, sizeof(word));
+    }
+    // Planted at known offsets: scanning must report each of them.
+    std::vector<std::vector<size_t>> planted(kPatternCount);
+    for (size_t k = 0; k < kPatternCount; ++k) {
+        for (size_t j = 0; j < kPlantsPerPattern; ++j) {
+            auto bytes = instance(kPatterns[k], &state);
+            auto offset = ((size_t) next_random(&state) % (size - bytes.size())) & ~(size_t) 3;
+            memcpy(&code[offset], bytes.data(), bytes.size());
+            planted[k].push_back(offset);
+        }
+    }
+
+    double best_ms = 0;
+    for (int run = 0; run < kRuns; ++run) {
+        SignatureSet set;
+        for (size_t k = 0; k < kPatternCount; ++k) {
+            CHECK(set.add(("p" + std::to_string(k)).c_str(), kPatterns[k]));
+        }
+        auto start = std::chrono::steady_clock::now();
+        set.scan(code.data(), code.size(), 0);
+        auto ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        best_ms = run == 0 ? ms : std::min(best_ms, ms);
+        for (size_t k = 0; k < kPatternCount; ++k) {
+            auto &matches = set.matches(k);
+            for (auto offset: planted[k]) {
+                CHECK(std::find(matches.begin(), matches.end(), offset) != matches.end() ||
+                      set.match_count(k) > kSignatureMaxMatches);
+            }
+        }
+    }
+#if defined(SIGNATURE_SCAN_SCALAR)
+    const char *path = "scalar";
+#else
+    const char *path = "vector";
+#endif
+    // Pattern-MiB/s as in SignatureSet::record_stats: what one pass per pattern would need to keep up.
+    auto mib_per_sec = (double) (size >> 20) / (best_ms / 1000);
+    printf("%s: %zu patterns over %zu MiB in %.1f ms, %.0f MiB/s, %.0f pattern-MiB/s\n", path, kPatternCount,
+           size >> 20, best_ms, mib_per_sec, mib_per_sec * kPatternCount);
+
+    check_module(&state);
+    return TEST_RESULT();
+}
@@ -0,0 +1,24 @@
+//
+// Minimal checks for the host tests: each test is its own executable, run by ctest.
+//
+
+#ifndef ZYGISK_IL2CPPDUMPER_TEST_H
+#define ZYGISK_IL2CPPDUMPER_TEST_H
+
+#include <cstdio>
+#include <cstdlib>
+
+static int test_failures = 0;
+
+#define CHECK(condition)                                                          \
+    do {                                                                          \
+        if (!(condition)) {                                                       \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__,      \
+                    #condition);                                                  \
+            test_failures++;                                                      \
+        }                                                                         \
+    } while (0)
+
+#define TEST_RESULT() (test_failures ? (fprintf(stderr, "%d check(s) failed\n", test_failures), 1) : 0)
+
+#endif //ZYGISK_IL2CPPDUMPER_TEST_H